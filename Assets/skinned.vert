@@ -5,6 +5,8 @@ layout (location = 1) in vec3 aNormal;
 layout (location = 2) in vec2 aTexCoord;
 layout (location = 3) in ivec4 aBoneIds;
 layout (location = 4) in vec4 aBoneWeights;
+layout (location = 5) in vec4 aInstanceAnimation;	// baked playback: first frame, duration in frames, frames per second, start time
+layout (location = 6) in vec4 aInstanceOffset;
 
 uniform mat4 uProjection;
 uniform mat4 uView;
@@ -13,6 +15,12 @@ uniform mat4 uModel;
 const int MAX_BONES = 100;
 uniform mat4 uBones[MAX_BONES];
 
+// baked playback fetches the palette from an AnimationTexture instead of uBones
+uniform bool uUseBakedBones;
+uniform samplerBuffer uBakedBones;
+uniform int uNumBakedBones;
+uniform float uTime;
+
 out VS_OUT {
 	vec2 TexCoords;
 	vec3 Normal;
@@ -20,6 +28,30 @@ out VS_OUT {
 	vec4 BoneWeights;
 } vs_out;
 
+// three texels per bone hold the rows of its 3x4 matrix
+mat4 FetchBakedBone(int frame, int bone)
+{
+	int texel = (frame * uNumBakedBones + bone) * 3;
+	vec4 row0 = texelFetch(uBakedBones, texel);
+	vec4 row1 = texelFetch(uBakedBones, texel + 1);
+	vec4 row2 = texelFetch(uBakedBones, texel + 2);
+	return transpose(mat4(row0, row1, row2, vec4(0, 0, 0, 1)));
+}
+
+mat4 GetBoneTransform(int bone)
+{
+	if (!uUseBakedBones)
+		return uBones[bone];
+
+	float duration = aInstanceAnimation.y;
+	float frame = mod((uTime - aInstanceAnimation.w) * aInstanceAnimation.z, max(duration, 0.0001));
+	float frame0 = floor(frame);
+	float factor = (frame - frame0) / max(min(frame0 + 1.0, duration) - frame0, 0.0001);
+
+	int first = int(aInstanceAnimation.x) + int(frame0);
+	return mix(FetchBakedBone(first, bone), FetchBakedBone(first + 1, bone), factor);
+}
+
 void main()
 {
 	vs_out.TexCoords = aTexCoord;
@@ -27,13 +59,14 @@ void main()
 	vs_out.BoneIds = aBoneIds;
 	vs_out.BoneWeights = aBoneWeights;
 
-	mat4 boneTransform = uBones[aBoneIds[0]] * aBoneWeights[0];
-	boneTransform += uBones[aBoneIds[1]] * aBoneWeights[1];
-	boneTransform += uBones[aBoneIds[2]] * aBoneWeights[2];
-	boneTransform += uBones[aBoneIds[3]] * aBoneWeights[3];
+	mat4 boneTransform = GetBoneTransform(aBoneIds[0]) * aBoneWeights[0];
+	boneTransform += GetBoneTransform(aBoneIds[1]) * aBoneWeights[1];
+	boneTransform += GetBoneTransform(aBoneIds[2]) * aBoneWeights[2];
+	boneTransform += GetBoneTransform(aBoneIds[3]) * aBoneWeights[3];
 
 	vec4 pos = vec4(aPos, 1);
 	pos = boneTransform * pos;
 
-	gl_Position = uProjection * uView * uModel * pos;
+	// Render disables the instance arrays and sets the offset to a constant (0, 0, 0, 1)
+	gl_Position = uProjection * uView * (uModel * pos + vec4(aInstanceOffset.xyz, 0));
 }
\ No newline at end of file
@@ -38,6 +38,10 @@ workspace "AssimpSkeletalAnimation"
             "{COPY} %{wks.location}/dependencies/lib/assimp-vc143-mtd.dll %{cfg.targetdir}"
         }
 
+        -- only this file may contain AVX2 code, the sampler picks it at runtime after a CPUID check
+        filter "files:src/AnimationSamplerAVX2.cpp"
+            vectorextensions "AVX2"
+
         filter "configurations:Debug"
             symbols "On"
             runtime "Debug"
@@ -0,0 +1,75 @@
+#include "AffineTransform.h"
+
+// Builds translation * rotation * scale for four nodes whose components are spread over the lanes
+static inline void ComposeFourAffines(__m128 x, __m128 y, __m128 z, __m128 w, __m128 sx, __m128 sy, __m128 sz,
+	__m128 m03, __m128 m13, __m128 m23, Affine3x4* out0, Affine3x4* out1, Affine3x4* out2, Affine3x4* out3)
+{
+	const __m128 one = _mm_set1_ps(1.0f);
+
+	__m128 x2 = _mm_add_ps(x, x), y2 = _mm_add_ps(y, y), z2 = _mm_add_ps(z, z);
+	__m128 xx = _mm_mul_ps(x, x2), yy = _mm_mul_ps(y, y2), zz = _mm_mul_ps(z, z2);
+	__m128 xy = _mm_mul_ps(x, y2), xz = _mm_mul_ps(x, z2), yz = _mm_mul_ps(y, z2);
+	__m128 wx = _mm_mul_ps(w, x2), wy = _mm_mul_ps(w, y2), wz = _mm_mul_ps(w, z2);
+
+	// rotation matrix with its columns scaled, translation in the fourth column
+	__m128 m00 = _mm_mul_ps(_mm_sub_ps(one, _mm_add_ps(yy, zz)), sx);
+	__m128 m01 = _mm_mul_ps(_mm_sub_ps(xy, wz), sy);
+	__m128 m02 = _mm_mul_ps(_mm_add_ps(xz, wy), sz);
+
+	__m128 m10 = _mm_mul_ps(_mm_add_ps(xy, wz), sx);
+	__m128 m11 = _mm_mul_ps(_mm_sub_ps(one, _mm_add_ps(xx, zz)), sy);
+	__m128 m12 = _mm_mul_ps(_mm_sub_ps(yz, wx), sz);
+
+	__m128 m20 = _mm_mul_ps(_mm_sub_ps(xz, wy), sx);
+	__m128 m21 = _mm_mul_ps(_mm_add_ps(yz, wx), sy);
+	__m128 m22 = _mm_mul_ps(_mm_sub_ps(one, _mm_add_ps(xx, yy)), sz);
+
+	// each matrix element is spread over four nodes, transposing gives one row per node
+	_MM_TRANSPOSE4_PS(m00, m01, m02, m03);
+	_MM_TRANSPOSE4_PS(m10, m11, m12, m13);
+	_MM_TRANSPOSE4_PS(m20, m21, m22, m23);
+
+	out0->Rows[0] = m00; out0->Rows[1] = m10; out0->Rows[2] = m20;
+	out1->Rows[0] = m01; out1->Rows[1] = m11; out1->Rows[2] = m21;
+	out2->Rows[0] = m02; out2->Rows[1] = m12; out2->Rows[2] = m22;
+	out3->Rows[0] = m03; out3->Rows[1] = m13; out3->Rows[2] = m23;
+}
+
+void LocalPoseToAffine(const LocalPose& pose, AlignedVector<Affine3x4>& out)
+{
+	unsigned int paddedSize = (pose.NumNodes + 3) & ~3u;
+	out.resize(paddedSize);
+
+	for (unsigned int i = 0; i < paddedSize; i += 4)
+	{
+		ComposeFourAffines(
+			_mm_load_ps(&pose.RotationX[i]), _mm_load_ps(&pose.RotationY[i]), _mm_load_ps(&pose.RotationZ[i]), _mm_load_ps(&pose.RotationW[i]),
+			_mm_load_ps(&pose.ScalingX[i]), _mm_load_ps(&pose.ScalingY[i]), _mm_load_ps(&pose.ScalingZ[i]),
+			_mm_load_ps(&pose.PositionX[i]), _mm_load_ps(&pose.PositionY[i]), _mm_load_ps(&pose.PositionZ[i]),
+			&out[i + 0], &out[i + 1], &out[i + 2], &out[i + 3]);
+	}
+}
+
+void LocalPoseToAffine(const LocalPose& pose, const std::vector<unsigned int>& nodes, AlignedVector<Affine3x4>& out)
+{
+	out.resize((pose.NumNodes + 3) & ~3u);
+
+	unsigned int numNodes = (unsigned int)nodes.size();
+
+	for (unsigned int i = 0; i < numNodes; i += 4)
+	{
+		// a last group of fewer than four repeats its last node, which just writes it again
+		unsigned int a = nodes[i];
+		unsigned int b = nodes[glm::min(i + 1, numNodes - 1)];
+		unsigned int c = nodes[glm::min(i + 2, numNodes - 1)];
+		unsigned int d = nodes[glm::min(i + 3, numNodes - 1)];
+
+		auto gather = [&](const AlignedVector<float>& v) { return _mm_set_ps(v[d], v[c], v[b], v[a]); };
+
+		ComposeFourAffines(
+			gather(pose.RotationX), gather(pose.RotationY), gather(pose.RotationZ), gather(pose.RotationW),
+			gather(pose.ScalingX), gather(pose.ScalingY), gather(pose.ScalingZ),
+			gather(pose.PositionX), gather(pose.PositionY), gather(pose.PositionZ),
+			&out[a], &out[b], &out[c], &out[d]);
+	}
+}
@@ -0,0 +1,59 @@
+#pragma once
+
+#include <glm/glm.hpp>
+#include <immintrin.h>
+#include <vector>
+
+#include "AlignedAllocator.h"
+#include "Pose.h"
+
+// Affine transform stored as the top three rows of a 4x4 matrix, one SSE register per row.
+// The implicit fourth row is (0, 0, 0, 1), so composing two of them never touches it
+struct Affine3x4
+{
+	__m128 Rows[3];
+};
+
+inline Affine3x4 AffineFromMat4(const glm::mat4& m)
+{
+	Affine3x4 a;
+	for (int r = 0; r < 3; r++)
+		a.Rows[r] = _mm_set_ps(m[3][r], m[2][r], m[1][r], m[0][r]);
+	return a;
+}
+
+inline void AffineToMat4(const Affine3x4& a, glm::mat4& m)
+{
+	__m128 c0 = a.Rows[0], c1 = a.Rows[1], c2 = a.Rows[2], c3 = _mm_set_ps(1.0f, 0.0f, 0.0f, 0.0f);
+	_MM_TRANSPOSE4_PS(c0, c1, c2, c3);
+
+	_mm_storeu_ps(&m[0][0], c0);
+	_mm_storeu_ps(&m[1][0], c1);
+	_mm_storeu_ps(&m[2][0], c2);
+	_mm_storeu_ps(&m[3][0], c3);
+}
+
+// a * b
+inline Affine3x4 AffineMul(const Affine3x4& a, const Affine3x4& b)
+{
+	const __m128 translationMask = _mm_castsi128_ps(_mm_set_epi32(-1, 0, 0, 0));
+
+	Affine3x4 result;
+	for (int r = 0; r < 3; r++)
+	{
+		__m128 row = a.Rows[r];
+		__m128 x = _mm_mul_ps(_mm_shuffle_ps(row, row, _MM_SHUFFLE(0, 0, 0, 0)), b.Rows[0]);
+		__m128 y = _mm_mul_ps(_mm_shuffle_ps(row, row, _MM_SHUFFLE(1, 1, 1, 1)), b.Rows[1]);
+		__m128 z = _mm_mul_ps(_mm_shuffle_ps(row, row, _MM_SHUFFLE(2, 2, 2, 2)), b.Rows[2]);
+		result.Rows[r] = _mm_add_ps(_mm_add_ps(x, y), _mm_add_ps(z, _mm_and_ps(row, translationMask)));
+	}
+	return result;
+}
+
+// Converts every node of a pose to translation * rotation * scale, four nodes per iteration.
+// out is resized to the pose node count rounded up to 4
+void LocalPoseToAffine(const LocalPose& pose, AlignedVector<Affine3x4>& out);
+
+// Same for the listed nodes only, so the cost follows the animated nodes rather than the whole skeleton.
+// out is sized like above, entries of other nodes are left as they were
+void LocalPoseToAffine(const LocalPose& pose, const std::vector<unsigned int>& nodes, AlignedVector<Affine3x4>& out);
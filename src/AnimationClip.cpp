@@ -0,0 +1,546 @@
+#include "AnimationClip.h"
+
+#include <algorithm>
+#include <cstdio>
+#include "Skeleton.h"
+
+static void LoadChannel(AnimationChannel& channel, const aiNodeAnim* nodeAnim)
+{
+	channel.PositionTimes.resize(nodeAnim->mNumPositionKeys);
+	channel.Positions.resize(nodeAnim->mNumPositionKeys);
+	for (unsigned int i = 0; i < nodeAnim->mNumPositionKeys; i++)
+	{
+		const aiVectorKey& key = nodeAnim->mPositionKeys[i];
+		channel.PositionTimes[i] = (float)key.mTime;
+		channel.Positions[i] = glm::vec3(key.mValue.x, key.mValue.y, key.mValue.z);
+	}
+
+	channel.RotationTimes.resize(nodeAnim->mNumRotationKeys);
+	channel.Rotations.resize(nodeAnim->mNumRotationKeys);
+	for (unsigned int i = 0; i < nodeAnim->mNumRotationKeys; i++)
+	{
+		const aiQuatKey& key = nodeAnim->mRotationKeys[i];
+		channel.RotationTimes[i] = (float)key.mTime;
+		channel.Rotations[i] = glm::quat(key.mValue.w, key.mValue.x, key.mValue.y, key.mValue.z);
+	}
+
+	channel.ScalingTimes.resize(nodeAnim->mNumScalingKeys);
+	channel.Scalings.resize(nodeAnim->mNumScalingKeys);
+	for (unsigned int i = 0; i < nodeAnim->mNumScalingKeys; i++)
+	{
+		const aiVectorKey& key = nodeAnim->mScalingKeys[i];
+		channel.ScalingTimes[i] = (float)key.mTime;
+		channel.Scalings[i] = glm::vec3(key.mValue.x, key.mValue.y, key.mValue.z);
+	}
+}
+
+// Value of a raw track at time, holding the end keys outside it. An empty track gives fallback
+template <typename T, typename InterpolateFunc>
+static T SampleTrack(const AlignedVector<float>& times, const AlignedVector<T>& values, float time, const T& fallback, InterpolateFunc interpolate)
+{
+	if (values.empty())
+		return fallback;
+	if (values.size() == 1)
+		return values[0];
+
+	size_t next = std::upper_bound(times.begin(), times.end(), time) - times.begin();
+	next = glm::clamp<size_t>(next, 1, times.size() - 1);
+	size_t prev = next - 1;
+
+	float factor = glm::clamp((time - times[prev]) / (times[next] - times[prev]), 0.0f, 1.0f);
+	return interpolate(values[prev], values[next], factor);
+}
+
+// Bakes the channels of a collapsed FBX helper chain into one channel keyed at the union of their key times.
+// Chain members without a channel hold their bind transform
+static void FoldChannels(AnimationChannel& channel, const std::vector<FoldedNode>& chain, const std::vector<const aiNodeAnim*>& nodeAnims)
+{
+	auto lerp = [](const glm::vec3& a, const glm::vec3& b, float t) { return glm::mix(a, b, t); };
+	auto slerp = [](const glm::quat& a, const glm::quat& b, float t) { return glm::normalize(glm::slerp(a, b, t)); };
+
+	std::vector<AnimationChannel> members(chain.size());
+	std::vector<float> times;
+
+	for (size_t i = 0; i < chain.size(); i++)
+	{
+		if (!nodeAnims[i])
+			continue;
+
+		AnimationChannel& member = members[i];
+		LoadChannel(member, nodeAnims[i]);
+		times.insert(times.end(), member.PositionTimes.begin(), member.PositionTimes.end());
+		times.insert(times.end(), member.RotationTimes.begin(), member.RotationTimes.end());
+		times.insert(times.end(), member.ScalingTimes.begin(), member.ScalingTimes.end());
+	}
+
+	std::sort(times.begin(), times.end());
+	times.erase(std::unique(times.begin(), times.end()), times.end());
+
+	if (times.empty())
+		times.push_back(0.0f);
+
+	std::vector<glm::vec3> bindPositions(chain.size()), bindScalings(chain.size());
+	std::vector<glm::quat> bindRotations(chain.size());
+	for (size_t i = 0; i < chain.size(); i++)
+		DecomposeTransform(chain[i].BindLocal, bindPositions[i], bindRotations[i], bindScalings[i]);
+
+	for (float time : times)
+	{
+		glm::mat4 local(1.0f);
+
+		for (size_t i = 0; i < chain.size(); i++)
+		{
+			const AnimationChannel& member = members[i];
+
+			glm::mat4 memberLocal = glm::mat4_cast(SampleTrack(member.RotationTimes, member.Rotations, time, bindRotations[i], slerp));
+			glm::vec3 scaling = SampleTrack(member.ScalingTimes, member.Scalings, time, bindScalings[i], lerp);
+			memberLocal[0] *= scaling.x; memberLocal[1] *= scaling.y; memberLocal[2] *= scaling.z;
+			memberLocal[3] = glm::vec4(SampleTrack(member.PositionTimes, member.Positions, time, bindPositions[i], lerp), 1.0f);
+
+			local = local * memberLocal;
+		}
+
+		glm::vec3 position, scaling;
+		glm::quat rotation;
+		DecomposeTransform(local, position, rotation, scaling);
+
+		channel.PositionTimes.push_back(time);
+		channel.Positions.push_back(position);
+		channel.RotationTimes.push_back(time);
+		channel.Rotations.push_back(rotation);
+		channel.ScalingTimes.push_back(time);
+		channel.Scalings.push_back(scaling);
+	}
+}
+
+// Replaces a track with numKeys keys spaced keyInterval ticks apart. Single key tracks are constant and left alone
+template <typename T, typename InterpolateFunc>
+static void ResampleTrack(AlignedVector<float>& times, AlignedVector<T>& values, unsigned int numKeys, float keyInterval, InterpolateFunc interpolate)
+{
+	if (values.size() < 2)
+		return;
+
+	AlignedVector<float> newTimes(numKeys);
+	AlignedVector<T> newValues(numKeys);
+
+	for (unsigned int i = 0; i < numKeys; i++)
+	{
+		float time = i * keyInterval;
+
+		size_t next = std::upper_bound(times.begin(), times.end(), time) - times.begin();
+		next = glm::clamp<size_t>(next, 1, times.size() - 1);
+		size_t prev = next - 1;
+
+		float factor = glm::clamp((time - times[prev]) / (times[next] - times[prev]), 0.0f, 1.0f);
+
+		newTimes[i] = time;
+		newValues[i] = interpolate(values[prev], values[next], factor);
+	}
+
+	times.swap(newTimes);
+	values.swap(newValues);
+}
+
+void AnimationClip::Load(const aiAnimation* animation, const Skeleton& skeleton, const AnimationImportSettings& settings)
+{
+	m_Name = animation->mName.C_Str();
+	m_Duration = (float)animation->mDuration;
+	m_TicksPerSecond = animation->mTicksPerSecond != 0 ? (float)animation->mTicksPerSecond : 25.0f;
+	m_RotationMode = settings.RotationMode;
+
+	const std::vector<std::string>& nodeNames = skeleton.GetNodeNames();
+
+	m_Channels.clear();
+	m_NodeChannels.assign(nodeNames.size(), -1);
+	m_ChannelNodes.clear();
+
+	for (unsigned int i = 0; i < nodeNames.size(); i++)
+	{
+		const std::vector<FoldedNode>& chain = skeleton.GetFoldedChain(i);
+
+		if (!chain.empty())
+		{
+			std::vector<const aiNodeAnim*> nodeAnims(chain.size(), nullptr);
+			bool animated = false;
+
+			for (size_t k = 0; k < chain.size(); k++)
+			{
+				for (unsigned int j = 0; j < animation->mNumChannels && !nodeAnims[k]; j++)
+				{
+					if (chain[k].Name == animation->mChannels[j]->mNodeName.C_Str())
+						nodeAnims[k] = animation->mChannels[j];
+				}
+				animated |= nodeAnims[k] != nullptr;
+			}
+
+			if (animated)
+			{
+				m_NodeChannels[i] = (int)m_Channels.size();
+				m_ChannelNodes.push_back(i);
+				m_Channels.emplace_back();
+				FoldChannels(m_Channels.back(), chain, nodeAnims);
+			}
+			continue;
+		}
+
+		for (unsigned int j = 0; j < animation->mNumChannels; j++)
+		{
+			const aiNodeAnim* nodeAnim = animation->mChannels[j];
+
+			if (nodeNames[i] == nodeAnim->mNodeName.C_Str())
+			{
+				m_NodeChannels[i] = (int)m_Channels.size();
+				m_ChannelNodes.push_back(i);
+				m_Channels.emplace_back();
+				LoadChannel(m_Channels.back(), nodeAnim);
+				break;
+			}
+		}
+	}
+
+	m_NumUniformKeys = 0;
+	m_InvKeyInterval = 0.0f;
+
+	if (settings.ResampleRate > 0.0f)
+		Resample(settings.ResampleRate);
+
+	m_Additive = settings.Additive != NOT_ADDITIVE;
+	m_RootMotion = RootMotionCurve();
+
+	if (settings.ExtractRootMotion && !m_Additive)
+		ExtractRootMotion(settings, skeleton);
+
+	if (m_Additive)
+		MakeAdditive(settings.Additive, skeleton);
+
+	if (settings.ReduceKeys)
+		ReduceKeys(settings);
+
+	AlignRotationHemispheres();
+
+	m_CompressionReport = AnimationCompressionReport();
+
+	if (settings.Compress)
+		Compress(settings);
+}
+
+void AnimationClip::Resample(float resampleRate)
+{
+	float keyInterval = m_TicksPerSecond / resampleRate;
+	unsigned int numKeys = (unsigned int)glm::ceil(m_Duration / keyInterval) + 1;
+	numKeys = glm::max(numKeys, 2u);
+
+	auto lerp = [](const glm::vec3& a, const glm::vec3& b, float t) { return glm::mix(a, b, t); };
+	auto slerp = [](const glm::quat& a, const glm::quat& b, float t) { return glm::normalize(glm::slerp(a, b, t)); };
+
+	for (AnimationChannel& channel : m_Channels)
+	{
+		ResampleTrack(channel.PositionTimes, channel.Positions, numKeys, keyInterval, lerp);
+		ResampleTrack(channel.RotationTimes, channel.Rotations, numKeys, keyInterval, slerp);
+		ResampleTrack(channel.ScalingTimes, channel.Scalings, numKeys, keyInterval, lerp);
+	}
+
+	m_NumUniformKeys = numKeys;
+	m_InvKeyInterval = 1.0f / keyInterval;
+}
+
+// Rewrites every key as a delta from the reference pose, such that reference * delta gives back the key:
+// positions are offsets, rotations are conjugate(reference) * key, scales are ratios.
+// Applying a layer is then one quaternion multiply and one vector add per node
+void AnimationClip::MakeAdditive(AdditiveReference reference, const Skeleton& skeleton)
+{
+	const LocalPose& bindPose = skeleton.GetBindPose();
+
+	for (size_t i = 0; i < m_Channels.size(); i++)
+	{
+		AnimationChannel& channel = m_Channels[i];
+		unsigned int nodeIndex = m_ChannelNodes[i];
+
+		glm::vec3 referencePosition = reference == FIRST_FRAME_REFERENCE ? channel.Positions[0] : bindPose.GetPosition(nodeIndex);
+		glm::quat referenceRotation = reference == FIRST_FRAME_REFERENCE ? channel.Rotations[0] : bindPose.GetRotation(nodeIndex);
+		glm::vec3 referenceScaling = reference == FIRST_FRAME_REFERENCE ? channel.Scalings[0] : bindPose.GetScaling(nodeIndex);
+
+		glm::quat inverseReferenceRotation = glm::conjugate(glm::normalize(referenceRotation));
+		glm::vec3 inverseReferenceScaling = glm::vec3(1.0f) / glm::max(glm::abs(referenceScaling), glm::vec3(1e-6f)) * glm::sign(referenceScaling);
+
+		for (glm::vec3& position : channel.Positions)
+			position -= referencePosition;
+
+		for (glm::quat& rotation : channel.Rotations)
+			rotation = glm::normalize(inverseReferenceRotation * rotation);
+
+		for (glm::vec3& scaling : channel.Scalings)
+			scaling *= inverseReferenceScaling;
+	}
+}
+
+// Greedily keeps the fewest keys such that every dropped key is rebuilt by interpolating
+// the kept keys around it within tolerance. A track that never leaves tolerance collapses to one key
+template <typename T, typename InterpolateFunc, typename ErrorFunc>
+static void ReduceTrack(AlignedVector<float>& times, AlignedVector<T>& values, float tolerance, InterpolateFunc interpolate, ErrorFunc error)
+{
+	size_t numKeys = values.size();
+
+	if (numKeys < 2)
+		return;
+
+	AlignedVector<float> newTimes;
+	AlignedVector<T> newValues;
+
+	size_t start = 0;
+	newTimes.push_back(times[0]);
+	newValues.push_back(values[0]);
+
+	for (size_t end = 2; end < numKeys; end++)
+	{
+		bool fits = true;
+		for (size_t i = start + 1; i < end && fits; i++)
+		{
+			float factor = (times[i] - times[start]) / (times[end] - times[start]);
+			fits = error(interpolate(values[start], values[end], factor), values[i]) <= tolerance;
+		}
+
+		if (!fits)
+		{
+			start = end - 1;
+			newTimes.push_back(times[start]);
+			newValues.push_back(values[start]);
+		}
+	}
+
+	newTimes.push_back(times[numKeys - 1]);
+	newValues.push_back(values[numKeys - 1]);
+
+	if (newValues.size() == 2 && error(newValues[0], newValues[1]) <= tolerance)
+	{
+		newTimes.pop_back();
+		newValues.pop_back();
+	}
+
+	times.swap(newTimes);
+	values.swap(newValues);
+}
+
+void AnimationClip::ReduceKeys(const AnimationImportSettings& settings)
+{
+	auto lerp = [](const glm::vec3& a, const glm::vec3& b, float t) { return glm::mix(a, b, t); };
+	auto slerp = [](const glm::quat& a, const glm::quat& b, float t) { return glm::normalize(glm::slerp(a, b, t)); };
+	auto distance = [](const glm::vec3& a, const glm::vec3& b) { return glm::length(a - b); };
+	auto angle = [](const glm::quat& a, const glm::quat& b) { return QuatAngleBetween(a, b); };
+
+	size_t numKeysBefore = 0;
+	size_t numKeysAfter = 0;
+
+	for (AnimationChannel& channel : m_Channels)
+	{
+		numKeysBefore += channel.Positions.size() + channel.Rotations.size() + channel.Scalings.size();
+
+		ReduceTrack(channel.PositionTimes, channel.Positions, settings.PositionTolerance, lerp, distance);
+		ReduceTrack(channel.RotationTimes, channel.Rotations, settings.RotationTolerance, slerp, angle);
+		ReduceTrack(channel.ScalingTimes, channel.Scalings, settings.ScalingTolerance, lerp, distance);
+
+		numKeysAfter += channel.Positions.size() + channel.Rotations.size() + channel.Scalings.size();
+	}
+
+	// the remaining keys are no longer evenly spaced
+	m_NumUniformKeys = 0;
+	m_InvKeyInterval = 0.0f;
+
+	printf("Reduced clip '%s': %zu -> %zu keys\n", m_Name.c_str(), numKeysBefore, numKeysAfter);
+}
+
+// Splits the root's position keys into a pose part and a ground plane displacement from the first key.
+// The displacement is measured in model space, through the bind pose of the root's ancestors below the scene root
+void AnimationClip::ExtractRootMotion(const AnimationImportSettings& settings, const Skeleton& skeleton)
+{
+	int rootNode = -1;
+
+	if (!settings.RootMotionNode.empty())
+		rootNode = skeleton.FindNode(settings.RootMotionNode);
+	else
+	{
+		const std::vector<int>& boneIndices = skeleton.GetBoneIndices();
+		for (unsigned int i = 0; i < boneIndices.size() && rootNode < 0; i++)
+		{
+			if (boneIndices[i] >= 0)
+				rootNode = (int)i;
+		}
+	}
+
+	if (rootNode < 0 || m_NodeChannels[rootNode] < 0 || m_Channels[m_NodeChannels[rootNode]].Positions.empty())
+	{
+		printf("Clip '%s' has no root motion node to extract from\n", m_Name.c_str());
+		return;
+	}
+
+	const LocalPose& bindPose = skeleton.GetBindPose();
+	const std::vector<int>& parentIndices = skeleton.GetParentIndices();
+
+	// the scene root is cancelled by the global inverse transform, so it isn't part of model space
+	glm::mat3 toModel(1.0f);
+	for (int node = parentIndices[rootNode]; node > 0; node = parentIndices[node])
+	{
+		glm::mat3 local = glm::mat3_cast(bindPose.GetRotation(node));
+		glm::vec3 scaling = bindPose.GetScaling(node);
+		local[0] *= scaling.x; local[1] *= scaling.y; local[2] *= scaling.z;
+		toModel = local * toModel;
+	}
+	glm::mat3 toLocal = glm::inverse(toModel);
+
+	AnimationChannel& channel = m_Channels[m_NodeChannels[rootNode]];
+	glm::vec3 start = toModel * channel.Positions[0];
+
+	m_RootMotion.Times = channel.PositionTimes;
+	m_RootMotion.Displacements.resize(channel.Positions.size());
+
+	for (size_t i = 0; i < channel.Positions.size(); i++)
+	{
+		glm::vec3 displacement = toModel * channel.Positions[i] - start;
+		displacement.y = 0.0f;
+
+		m_RootMotion.Displacements[i] = displacement;
+		channel.Positions[i] -= toLocal * displacement;
+	}
+
+	auto lerp = [](const glm::vec3& a, const glm::vec3& b, float t) { return glm::mix(a, b, t); };
+	auto distance = [](const glm::vec3& a, const glm::vec3& b) { return glm::length(a - b); };
+	ReduceTrack(m_RootMotion.Times, m_RootMotion.Displacements, settings.PositionTolerance, lerp, distance);
+}
+
+glm::vec3 RootMotionCurve::Evaluate(float animationTimeInTicks) const
+{
+	if (Times.size() < 2)
+		return Times.empty() ? glm::vec3(0.0f) : Displacements[0];
+
+	size_t next = std::upper_bound(Times.begin(), Times.end(), animationTimeInTicks) - Times.begin();
+	next = glm::clamp<size_t>(next, 1, Times.size() - 1);
+	size_t prev = next - 1;
+
+	float factor = glm::clamp((animationTimeInTicks - Times[prev]) / (Times[next] - Times[prev]), 0.0f, 1.0f);
+	return glm::mix(Displacements[prev], Displacements[next], factor);
+}
+
+glm::vec3 AnimationClip::GetRootDisplacement(double fromTimeInSeconds, double toTimeInSeconds) const
+{
+	if (!HasRootMotion() || m_Duration <= 0.0f)
+		return glm::vec3(0.0f);
+
+	// every wrap between the two times adds one full cycle of displacement
+	double fromTicks = fromTimeInSeconds * m_TicksPerSecond;
+	double toTicks = toTimeInSeconds * m_TicksPerSecond;
+	float numLoops = (float)(floor(toTicks / m_Duration) - floor(fromTicks / m_Duration));
+
+	glm::vec3 cycle = m_RootMotion.Evaluate(m_Duration);
+	float from = (float)(fromTicks - floor(fromTicks / m_Duration) * m_Duration);
+	float to = (float)(toTicks - floor(toTicks / m_Duration) * m_Duration);
+
+	return cycle * numLoops + m_RootMotion.Evaluate(to) - m_RootMotion.Evaluate(from);
+}
+
+void AnimationClip::AlignRotationHemispheres()
+{
+	for (AnimationChannel& channel : m_Channels)
+	{
+		for (size_t i = 1; i < channel.Rotations.size(); i++)
+		{
+			if (glm::dot(channel.Rotations[i - 1], channel.Rotations[i]) < 0.0f)
+				channel.Rotations[i] = -channel.Rotations[i];
+		}
+	}
+}
+
+// Packs a vector track against its own bounding box, keeps it raw if the error would exceed maxError
+static void CompressVec3Track(AlignedVector<glm::vec3>& values, AlignedVector<PackedVec3>& packedValues, glm::vec3& rangeMin, glm::vec3& rangeExtent,
+	float maxError, float& trackError)
+{
+	trackError = 0.0f;
+
+	if (values.empty())
+		return;
+
+	glm::vec3 rangeMax = values[0];
+	rangeMin = values[0];
+	for (const glm::vec3& v : values)
+	{
+		rangeMin = glm::min(rangeMin, v);
+		rangeMax = glm::max(rangeMax, v);
+	}
+	rangeExtent = rangeMax - rangeMin;
+
+	AlignedVector<PackedVec3> packed(values.size());
+	for (size_t i = 0; i < values.size(); i++)
+	{
+		packed[i] = PackVec3(values[i], rangeMin, rangeExtent);
+		trackError = glm::max(trackError, glm::length(UnpackVec3(packed[i], rangeMin, rangeExtent) - values[i]));
+	}
+
+	if (trackError > maxError)
+	{
+		trackError = 0.0f;
+		return;
+	}
+
+	packedValues.swap(packed);
+	values.clear();
+	values.shrink_to_fit();
+}
+
+static void CompressQuatTrack(AlignedVector<glm::quat>& values, AlignedVector<PackedQuat>& packedValues, float maxError, float& trackError)
+{
+	trackError = 0.0f;
+
+	if (values.empty())
+		return;
+
+	AlignedVector<PackedQuat> packed(values.size());
+	for (size_t i = 0; i < values.size(); i++)
+	{
+		packed[i] = PackQuat(values[i]);
+
+		trackError = glm::max(trackError, QuatAngleBetween(glm::normalize(values[i]), UnpackQuat(packed[i])));
+	}
+
+	if (trackError > maxError)
+	{
+		trackError = 0.0f;
+		return;
+	}
+
+	packedValues.swap(packed);
+	values.clear();
+	values.shrink_to_fit();
+}
+
+static size_t GetChannelSize(const AnimationChannel& channel)
+{
+	return (channel.PositionTimes.size() + channel.RotationTimes.size() + channel.ScalingTimes.size()) * sizeof(float)
+		+ channel.Positions.size() * sizeof(glm::vec3) + channel.PackedPositions.size() * sizeof(PackedVec3)
+		+ channel.Rotations.size() * sizeof(glm::quat) + channel.PackedRotations.size() * sizeof(PackedQuat)
+		+ channel.Scalings.size() * sizeof(glm::vec3) + channel.PackedScalings.size() * sizeof(PackedVec3);
+}
+
+void AnimationClip::Compress(const AnimationImportSettings& settings)
+{
+	AnimationCompressionReport& report = m_CompressionReport;
+
+	for (AnimationChannel& channel : m_Channels)
+	{
+		report.RawBytes += GetChannelSize(channel);
+
+		float error;
+		CompressVec3Track(channel.Positions, channel.PackedPositions, channel.PositionMin, channel.PositionExtent, settings.MaxPositionError, error);
+		report.MaxPositionError = glm::max(report.MaxPositionError, error);
+
+		CompressQuatTrack(channel.Rotations, channel.PackedRotations, settings.MaxRotationError, error);
+		report.MaxRotationError = glm::max(report.MaxRotationError, error);
+
+		CompressVec3Track(channel.Scalings, channel.PackedScalings, channel.ScalingMin, channel.ScalingExtent, settings.MaxScalingError, error);
+		report.MaxScalingError = glm::max(report.MaxScalingError, error);
+
+		report.CompressedBytes += GetChannelSize(channel);
+	}
+
+	printf("Compressed clip '%s': %zu -> %zu bytes (%.2fx), max error position %f rotation %f scaling %f\n",
+		m_Name.c_str(), report.RawBytes, report.CompressedBytes, report.GetRatio(),
+		report.MaxPositionError, report.MaxRotationError, report.MaxScalingError);
+}
@@ -0,0 +1,186 @@
+#pragma once
+
+#include <glm/glm.hpp>
+#include <cmath>
+#include <glm/gtc/quaternion.hpp>
+#include <string>
+#include <vector>
+#include <assimp/anim.h>
+
+#include "AlignedAllocator.h"
+#include "AnimationCompression.h"
+
+class Skeleton;
+
+// Keys of one node, stored as separate time and value arrays.
+// A track is either raw or packed, the packed arrays are empty when it is raw and vice versa
+struct AnimationChannel
+{
+	AlignedVector<float> PositionTimes;
+	AlignedVector<glm::vec3> Positions;
+	AlignedVector<PackedVec3> PackedPositions;
+	glm::vec3 PositionMin = glm::vec3(0.0f);
+	glm::vec3 PositionExtent = glm::vec3(0.0f);
+
+	AlignedVector<float> RotationTimes;
+	AlignedVector<glm::quat> Rotations;
+	AlignedVector<PackedQuat> PackedRotations;
+
+	AlignedVector<float> ScalingTimes;
+	AlignedVector<glm::vec3> Scalings;
+	AlignedVector<PackedVec3> PackedScalings;
+	glm::vec3 ScalingMin = glm::vec3(0.0f);
+	glm::vec3 ScalingExtent = glm::vec3(0.0f);
+
+	glm::vec3 GetPosition(unsigned int keyIndex) const
+	{
+		return PackedPositions.empty() ? Positions[keyIndex] : UnpackVec3(PackedPositions[keyIndex], PositionMin, PositionExtent);
+	}
+
+	glm::quat GetRotation(unsigned int keyIndex) const
+	{
+		return PackedRotations.empty() ? Rotations[keyIndex] : UnpackQuat(PackedRotations[keyIndex]);
+	}
+
+	glm::vec3 GetScaling(unsigned int keyIndex) const
+	{
+		return PackedScalings.empty() ? Scalings[keyIndex] : UnpackVec3(PackedScalings[keyIndex], ScalingMin, ScalingExtent);
+	}
+};
+
+// Size and worst round trip error of a clip after compression
+struct AnimationCompressionReport
+{
+	size_t RawBytes = 0;
+	size_t CompressedBytes = 0;
+	float MaxPositionError = 0.0f;
+	float MaxRotationError = 0.0f;		// radians
+	float MaxScalingError = 0.0f;
+
+	float GetRatio() const { return CompressedBytes > 0 ? (float)RawBytes / CompressedBytes : 1.0f; }
+};
+
+// Ground plane displacement of the root bone from the first frame, in model space (Y up).
+// Extracted at import so gameplay can query motion without evaluating the skeleton
+struct RootMotionCurve
+{
+	AlignedVector<float> Times;
+	AlignedVector<glm::vec3> Displacements;
+
+	glm::vec3 Evaluate(float animationTimeInTicks) const;
+};
+
+enum RotationInterpolation
+{
+	SLERP_ROTATION			= 0,	// exact, but needs acos/sin and a hemisphere check per key pair
+	NLERP_ROTATION			= 1,	// normalized lerp, fine for densely sampled clips
+	APPROX_SLERP_ROTATION	= 2		// nlerp with a polynomial correction of the factor, close to slerp at nlerp cost
+};
+
+enum AdditiveReference
+{
+	NOT_ADDITIVE			= 0,
+	FIRST_FRAME_REFERENCE	= 1,	// deltas against the clip's own first frame
+	BIND_POSE_REFERENCE		= 2		// deltas against the skeleton's bind pose
+};
+
+struct AnimationImportSettings
+{
+	// Resample every channel to this many keys per second so key lookup is a multiply and floor.
+	// 0 keeps the keys as they are in the source file
+	float ResampleRate = 0.0f;
+
+	// Store clips as deltas from a reference pose, to be layered on top of another clip with AddPoses
+	AdditiveReference Additive = NOT_ADDITIVE;
+
+	// Drop keys that linear interpolation of their neighbours rebuilds within these tolerances.
+	// Reduced clips are no longer uniform, so this turns the resampled O(1) lookup back into a search
+	bool ReduceKeys = false;
+	float PositionTolerance = 0.001f;
+	float RotationTolerance = 0.0005f;	// radians
+	float ScalingTolerance = 0.0001f;
+
+	// Rotation interpolation used by the sampler for clips imported with these settings.
+	// Consecutive rotation keys are always flipped onto the same hemisphere at import, so the nlerp modes need no branches
+	RotationInterpolation RotationMode = SLERP_ROTATION;
+
+	// Move the ground plane translation of RootMotionNode (the topmost bone when empty) out of the pose
+	// into a RootMotionCurve, so the character animates in place. Ignored for additive clips
+	bool ExtractRootMotion = false;
+	std::string RootMotionNode;
+
+	// Quantize tracks whose round trip error stays within these bounds, tracks that don't fit stay raw
+	bool Compress = false;
+	float MaxPositionError = 0.01f;
+	float MaxRotationError = 0.001f;	// radians
+	float MaxScalingError = 0.001f;
+};
+
+// Engine owned copy of an aiAnimation, so the Assimp scene can be released after import
+class AnimationClip
+{
+public:
+	AnimationClip() {};
+
+	void Load(const aiAnimation* animation, const Skeleton& skeleton, const AnimationImportSettings& settings);
+
+	const std::string& GetName() const { return m_Name; }
+	float GetDuration() const { return m_Duration; }
+	float GetTicksPerSecond() const { return m_TicksPerSecond; }
+	RotationInterpolation GetRotationMode() const { return m_RotationMode; }
+	bool IsAdditive() const { return m_Additive; }
+
+	// Wraps a playback time into the clip, the clip loops
+	float GetAnimationTimeInTicks(double timeInSeconds) const
+	{
+		return m_Duration > 0.0f ? (float)fmod(timeInSeconds * m_TicksPerSecond, (double)m_Duration) : 0.0f;
+	}
+
+	unsigned int GetNumChannels() const { return (unsigned int)m_Channels.size(); }
+	const AnimationChannel& GetChannel(unsigned int channelIndex) const { return m_Channels[channelIndex]; }
+
+	// -1 for skeleton nodes that keep their bind pose
+	int GetNodeChannel(unsigned int nodeIndex) const { return m_NodeChannels[nodeIndex]; }
+	unsigned int GetChannelNode(unsigned int channelIndex) const { return m_ChannelNodes[channelIndex]; }
+
+	// True when all animated tracks share the same evenly spaced keys
+	bool IsUniform() const { return m_NumUniformKeys >= 2; }
+
+	const AnimationCompressionReport& GetCompressionReport() const { return m_CompressionReport; }
+
+	bool HasRootMotion() const { return !m_RootMotion.Times.empty(); }
+	const RootMotionCurve& GetRootMotion() const { return m_RootMotion; }
+
+	// Model space root displacement between two playback times, counting every loop in between. O(log keys)
+	glm::vec3 GetRootDisplacement(double fromTimeInSeconds, double toTimeInSeconds) const;
+
+	unsigned int FindUniformKey(float animationTimeInTicks) const
+	{
+		return (unsigned int)glm::clamp(animationTimeInTicks * m_InvKeyInterval, 0.0f, (float)(m_NumUniformKeys - 2));
+	}
+
+private:
+	void Resample(float resampleRate);
+	void MakeAdditive(AdditiveReference reference, const Skeleton& skeleton);
+	void ExtractRootMotion(const AnimationImportSettings& settings, const Skeleton& skeleton);
+	void ReduceKeys(const AnimationImportSettings& settings);
+	void AlignRotationHemispheres();
+	void Compress(const AnimationImportSettings& settings);
+
+private:
+	std::string m_Name;
+	float m_Duration = 0.0f;			// in ticks
+	float m_TicksPerSecond = 25.0f;
+	RotationInterpolation m_RotationMode = SLERP_ROTATION;
+	bool m_Additive = false;
+
+	std::vector<AnimationChannel> m_Channels;
+	std::vector<int> m_NodeChannels;
+	std::vector<unsigned int> m_ChannelNodes;
+
+	unsigned int m_NumUniformKeys = 0;
+	float m_InvKeyInterval = 0.0f;		// keys per tick
+
+	AnimationCompressionReport m_CompressionReport;
+	RootMotionCurve m_RootMotion;
+};
@@ -0,0 +1,99 @@
+#pragma once
+
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+#include <cstdint>
+
+// Smallest three quaternion: the largest component is dropped (and rebuilt from the unit length),
+// the other three are in [-1/sqrt(2), 1/sqrt(2)] and stored in 15 bits each.
+// The index of the dropped component lives in the top bits of the first two words, and the top bit of
+// the third word records whether the quaternion was negated, so keys keep the hemisphere they were imported with.
+struct PackedQuat
+{
+	uint16_t Data[3];
+};
+
+// Range reduced vector, each component quantized to 16 bits between a per track minimum and extent
+struct PackedVec3
+{
+	uint16_t Data[3];
+};
+
+#define QUAT_COMPONENT_RANGE 0.70710678f
+#define QUAT_COMPONENT_STEPS 32767.0f
+#define VEC3_COMPONENT_STEPS 65535.0f
+
+// Angle of the rotation taking a to b, robust for nearly identical quaternions unlike acos(dot)
+inline float QuatAngleBetween(const glm::quat& a, const glm::quat& b)
+{
+	glm::quat delta = b * glm::conjugate(a);
+	return 2.0f * glm::atan(glm::length(glm::vec3(delta.x, delta.y, delta.z)), glm::abs(delta.w));
+}
+
+inline PackedQuat PackQuat(const glm::quat& q)
+{
+	float components[4] = { q.x, q.y, q.z, q.w };
+
+	unsigned int largest = 0;
+	for (unsigned int i = 1; i < 4; i++)
+	{
+		if (glm::abs(components[i]) > glm::abs(components[largest]))
+			largest = i;
+	}
+
+	// q and -q are the same rotation, so the dropped component can always be made positive
+	bool negated = components[largest] < 0.0f;
+	float sign = negated ? -1.0f : 1.0f;
+
+	uint16_t quantized[3];
+	for (unsigned int i = 0, j = 0; i < 4; i++)
+	{
+		if (i == largest)
+			continue;
+
+		float normalized = glm::clamp(sign * components[i] / QUAT_COMPONENT_RANGE * 0.5f + 0.5f, 0.0f, 1.0f);
+		quantized[j++] = (uint16_t)(normalized * QUAT_COMPONENT_STEPS + 0.5f);
+	}
+
+	PackedQuat packed;
+	packed.Data[0] = (uint16_t)(((largest >> 1) << 15) | quantized[0]);
+	packed.Data[1] = (uint16_t)(((largest & 1) << 15) | quantized[1]);
+	packed.Data[2] = (uint16_t)((negated ? 0x8000 : 0) | quantized[2]);
+	return packed;
+}
+
+inline glm::quat UnpackQuat(const PackedQuat& packed)
+{
+	unsigned int largest = ((packed.Data[0] >> 15) << 1) | (packed.Data[1] >> 15);
+
+	float a = ((packed.Data[0] & 0x7FFF) / QUAT_COMPONENT_STEPS * 2.0f - 1.0f) * QUAT_COMPONENT_RANGE;
+	float b = ((packed.Data[1] & 0x7FFF) / QUAT_COMPONENT_STEPS * 2.0f - 1.0f) * QUAT_COMPONENT_RANGE;
+	float c = ((packed.Data[2] & 0x7FFF) / QUAT_COMPONENT_STEPS * 2.0f - 1.0f) * QUAT_COMPONENT_RANGE;
+	float d = glm::sqrt(glm::max(0.0f, 1.0f - a * a - b * b - c * c));
+	float sign = (packed.Data[2] & 0x8000) ? -1.0f : 1.0f;
+
+	switch (largest)
+	{
+	case 0:		return sign * glm::quat(c, d, a, b);
+	case 1:		return sign * glm::quat(c, a, d, b);
+	case 2:		return sign * glm::quat(c, a, b, d);
+	default:	return sign * glm::quat(d, a, b, c);
+	}
+}
+
+inline PackedVec3 PackVec3(const glm::vec3& v, const glm::vec3& rangeMin, const glm::vec3& rangeExtent)
+{
+	PackedVec3 packed;
+	for (int i = 0; i < 3; i++)
+	{
+		float normalized = rangeExtent[i] > 0.0f ? glm::clamp((v[i] - rangeMin[i]) / rangeExtent[i], 0.0f, 1.0f) : 0.0f;
+		packed.Data[i] = (uint16_t)(normalized * VEC3_COMPONENT_STEPS + 0.5f);
+	}
+	return packed;
+}
+
+inline glm::vec3 UnpackVec3(const PackedVec3& packed, const glm::vec3& rangeMin, const glm::vec3& rangeExtent)
+{
+	glm::vec3 normalized(packed.Data[0], packed.Data[1], packed.Data[2]);
+	return rangeMin + normalized * (rangeExtent / VEC3_COMPONENT_STEPS);
+}
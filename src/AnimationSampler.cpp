@@ -0,0 +1,365 @@
+#include "AnimationSampler.h"
+
+#include "SamplerKernels.h"
+
+#include <algorithm>
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+// Defined in AnimationSamplerAVX2.cpp, which is the only file compiled with AVX2 code generation
+void LerpVec3AVX2(const Vec3Stream& start, const Vec3Stream& end, const float* factors, const Vec3Stream& out, unsigned int count);
+void SlerpQuatAVX2(const QuatStream& start, const QuatStream& end, const float* factors, const QuatStream& out, unsigned int count);
+void NlerpQuatAVX2(const QuatStream& start, const QuatStream& end, const float* factors, const QuatStream& out, unsigned int count);
+void ApproxSlerpQuatAVX2(const QuatStream& start, const QuatStream& end, const float* factors, const QuatStream& out, unsigned int count);
+void BlendPoseAVX2(const PoseStream& a, const PoseStream& b, const float* weights, const PoseStream& out, unsigned int count);
+void AddPoseAVX2(const PoseStream& base, const PoseStream& delta, const float* weights, const PoseStream& out, unsigned int count);
+
+typedef void (*QuatKernelFunc)(const QuatStream& start, const QuatStream& end, const float* factors, const QuatStream& out, unsigned int count);
+
+// [kernel][rotation mode]
+static const QuatKernelFunc s_QuatKernels[3][3] =
+{
+	{ SlerpQuatKernel<ScalarLane>, NlerpQuatKernel<ScalarLane>, ApproxSlerpQuatKernel<ScalarLane> },
+	{ SlerpQuatKernel<SSELane>, NlerpQuatKernel<SSELane>, ApproxSlerpQuatKernel<SSELane> },
+	{ SlerpQuatAVX2, NlerpQuatAVX2, ApproxSlerpQuatAVX2 }
+};
+
+static bool CpuSupportsAVX2()
+{
+#if defined(_MSC_VER)
+	int info[4];
+	__cpuid(info, 0);
+	if (info[0] < 7)
+		return false;
+
+	// AVX needs OS support for saving the ymm registers
+	__cpuid(info, 1);
+	bool osxsave = (info[2] & (1 << 27)) != 0;
+	bool avx = (info[2] & (1 << 28)) != 0;
+	if (!osxsave || !avx || (_xgetbv(0) & 6) != 6)
+		return false;
+
+	__cpuidex(info, 7, 0);
+	return (info[1] & (1 << 5)) != 0;
+#else
+	return __builtin_cpu_supports("avx2");
+#endif
+}
+
+SamplerKernel AnimationSampler::s_Kernel = AnimationSampler::GetBestKernel();
+
+SamplerKernel AnimationSampler::GetBestKernel()
+{
+	// SSE2 is part of x86_64, so it is always there
+	return CpuSupportsAVX2() ? AVX2_KERNEL : SSE_KERNEL;
+}
+
+void AnimationSampler::SetKernel(SamplerKernel kernel)
+{
+	s_Kernel = kernel <= GetBestKernel() ? kernel : GetBestKernel();
+}
+
+// The kernels only ever write through the output stream, so viewing an input pose as non-const is safe
+static PoseStream GetPoseStream(const LocalPose& pose)
+{
+	LocalPose& p = const_cast<LocalPose&>(pose);
+
+	PoseStream stream;
+	stream.Positions = { p.PositionX.data(), p.PositionY.data(), p.PositionZ.data() };
+	stream.Rotations = { p.RotationX.data(), p.RotationY.data(), p.RotationZ.data(), p.RotationW.data() };
+	stream.Scalings = { p.ScalingX.data(), p.ScalingY.data(), p.ScalingZ.data() };
+	return stream;
+}
+
+void AnimationSampler::BlendPoses(const LocalPose& a, const LocalPose& b, const float* weights, LocalPose& out)
+{
+	unsigned int count = (unsigned int)out.PositionX.size();
+
+	switch (s_Kernel)
+	{
+	case AVX2_KERNEL:
+		BlendPoseAVX2(GetPoseStream(a), GetPoseStream(b), weights, GetPoseStream(out), count);
+		break;
+
+	case SSE_KERNEL:
+		BlendPoseKernel<SSELane>(GetPoseStream(a), GetPoseStream(b), weights, GetPoseStream(out), count);
+		break;
+
+	default:
+		BlendPoseKernel<ScalarLane>(GetPoseStream(a), GetPoseStream(b), weights, GetPoseStream(out), count);
+		break;
+	}
+}
+
+void AnimationSampler::AddPoses(const LocalPose& base, const LocalPose& additive, const float* weights, LocalPose& out)
+{
+	unsigned int count = (unsigned int)out.PositionX.size();
+
+	switch (s_Kernel)
+	{
+	case AVX2_KERNEL:
+		AddPoseAVX2(GetPoseStream(base), GetPoseStream(additive), weights, GetPoseStream(out), count);
+		break;
+
+	case SSE_KERNEL:
+		AddPoseKernel<SSELane>(GetPoseStream(base), GetPoseStream(additive), weights, GetPoseStream(out), count);
+		break;
+
+	default:
+		AddPoseKernel<ScalarLane>(GetPoseStream(base), GetPoseStream(additive), weights, GetPoseStream(out), count);
+		break;
+	}
+}
+
+// Returns i such that times[i] <= time < times[i + 1], clamped to [0, numKeys - 2].
+// When a cursor is given the search starts from the last key found, so forward playback is O(1),
+// and falls back to a binary search on a miss (looping, seeking).
+static unsigned int FindKeyIndex(const float* times, unsigned int numKeys, float time, unsigned int* cursor)
+{
+	unsigned int lastSegment = numKeys - 2;
+
+	if (cursor)
+	{
+		unsigned int c = *cursor;
+		if (c <= lastSegment && times[c] <= time)
+		{
+			if (c == lastSegment || time < times[c + 1])
+				return c;
+			if (c + 1 == lastSegment || time < times[c + 2])
+				return *cursor = c + 1;
+		}
+	}
+
+	unsigned int index = 0;
+	if (time >= times[lastSegment])
+		index = lastSegment;
+	else
+	{
+		// first key with a time > time, minus one
+		unsigned int lo = 1, hi = lastSegment;
+		while (lo < hi)
+		{
+			unsigned int mid = (lo + hi) / 2;
+			if (times[mid] > time)
+				hi = mid;
+			else
+				lo = mid + 1;
+		}
+		index = lo - 1;
+	}
+
+	if (cursor)
+		*cursor = index;
+
+	return index;
+}
+
+static float CalcFactor(const AlignedVector<float>& times, unsigned int keyIndex, float animationTimeInTicks)
+{
+	float t1 = times[keyIndex];
+	float t2 = times[keyIndex + 1];
+	float deltaTime = t2 - t1;
+	return glm::clamp((animationTimeInTicks - t1) / deltaTime, 0.0f, 1.0f);
+}
+
+void AnimationSampler::StagedKeys::Resize(unsigned int paddedSize)
+{
+	StartPositionX.resize(paddedSize, 0.0f); StartPositionY.resize(paddedSize, 0.0f); StartPositionZ.resize(paddedSize, 0.0f);
+	EndPositionX.resize(paddedSize, 0.0f); EndPositionY.resize(paddedSize, 0.0f); EndPositionZ.resize(paddedSize, 0.0f);
+	PositionFactors.resize(paddedSize, 0.0f);
+
+	// padding lanes hold identity rotations so the kernels never see a zero length quaternion
+	StartRotationX.resize(paddedSize, 0.0f); StartRotationY.resize(paddedSize, 0.0f); StartRotationZ.resize(paddedSize, 0.0f); StartRotationW.resize(paddedSize, 1.0f);
+	EndRotationX.resize(paddedSize, 0.0f); EndRotationY.resize(paddedSize, 0.0f); EndRotationZ.resize(paddedSize, 0.0f); EndRotationW.resize(paddedSize, 1.0f);
+	RotationFactors.resize(paddedSize, 0.0f);
+
+	StartScalingX.resize(paddedSize, 1.0f); StartScalingY.resize(paddedSize, 1.0f); StartScalingZ.resize(paddedSize, 1.0f);
+	EndScalingX.resize(paddedSize, 1.0f); EndScalingY.resize(paddedSize, 1.0f); EndScalingZ.resize(paddedSize, 1.0f);
+	ScalingFactors.resize(paddedSize, 0.0f);
+}
+
+void AnimationSampler::Reserve(unsigned int maxChannels)
+{
+	unsigned int maxLanes = (maxChannels + 7) & ~7u;
+
+	m_Channels.reserve(maxChannels);
+	m_KeyCursors.reserve(maxChannels);
+
+	// only ever grows, so lanes a smaller clip doesn't use keep valid keys
+	if (m_Staged.PositionFactors.size() < maxLanes)
+		m_Staged.Resize(maxLanes);
+	if (m_ChannelPose.NumNodes < maxChannels)
+		m_ChannelPose.Resize(maxChannels);
+}
+
+void AnimationSampler::Bind(const AnimationClip* clip, const float* nodeWeights, const unsigned char* nodeLODs)
+{
+	m_Clip = clip;
+	m_Channels.clear();
+
+	// one pass per LOD from the highest down keeps channels of each LOD in clip order, without a sort buffer
+	for (int lod = MAX_SKELETON_LODS - 1; lod >= 0; lod--)
+	{
+		for (unsigned int i = 0; clip && i < clip->GetNumChannels(); i++)
+		{
+			unsigned int node = clip->GetChannelNode(i);
+			// without LODs every channel is sampled at every LOD
+			unsigned int channelLOD = nodeLODs ? glm::min<unsigned int>(nodeLODs[node], MAX_SKELETON_LODS - 1) : MAX_SKELETON_LODS - 1;
+
+			if (channelLOD == (unsigned int)lod && (!nodeWeights || nodeWeights[node] > 0.0f))
+				m_Channels.push_back(i);
+		}
+
+		m_LODChannelCounts[lod] = (unsigned int)m_Channels.size();
+	}
+
+	unsigned int numChannels = (unsigned int)m_Channels.size();
+
+	m_KeyCursors.assign(numChannels, KeyCursors());
+	m_NumLanes = (numChannels + 7) & ~7u;
+
+	Reserve(numChannels);
+}
+
+void AnimationSampler::Sample(float animationTimeInTicks, LocalPose& pose, unsigned int lod)
+{
+	if (!m_Clip)
+		return;
+
+	// lanes past the LOD's channels still hold keys from earlier samples, their results are never scattered
+	unsigned int numChannels = m_LODChannelCounts[glm::min(lod, MAX_SKELETON_LODS - 1u)];
+	unsigned int numLanes = (numChannels + 7) & ~7u;
+
+	GatherKeys(animationTimeInTicks, numChannels);
+
+	StagedKeys& k = m_Staged;
+	LocalPose& out = m_ChannelPose;
+
+	Vec3Stream startPositions = { k.StartPositionX.data(), k.StartPositionY.data(), k.StartPositionZ.data() };
+	Vec3Stream endPositions = { k.EndPositionX.data(), k.EndPositionY.data(), k.EndPositionZ.data() };
+	Vec3Stream outPositions = { out.PositionX.data(), out.PositionY.data(), out.PositionZ.data() };
+
+	QuatStream startRotations = { k.StartRotationX.data(), k.StartRotationY.data(), k.StartRotationZ.data(), k.StartRotationW.data() };
+	QuatStream endRotations = { k.EndRotationX.data(), k.EndRotationY.data(), k.EndRotationZ.data(), k.EndRotationW.data() };
+	QuatStream outRotations = { out.RotationX.data(), out.RotationY.data(), out.RotationZ.data(), out.RotationW.data() };
+
+	Vec3Stream startScalings = { k.StartScalingX.data(), k.StartScalingY.data(), k.StartScalingZ.data() };
+	Vec3Stream endScalings = { k.EndScalingX.data(), k.EndScalingY.data(), k.EndScalingZ.data() };
+	Vec3Stream outScalings = { out.ScalingX.data(), out.ScalingY.data(), out.ScalingZ.data() };
+
+	switch (s_Kernel)
+	{
+	case AVX2_KERNEL:
+		LerpVec3AVX2(startPositions, endPositions, k.PositionFactors.data(), outPositions, numLanes);
+		LerpVec3AVX2(startScalings, endScalings, k.ScalingFactors.data(), outScalings, numLanes);
+		break;
+
+	case SSE_KERNEL:
+		LerpVec3Kernel<SSELane>(startPositions, endPositions, k.PositionFactors.data(), outPositions, numLanes);
+		LerpVec3Kernel<SSELane>(startScalings, endScalings, k.ScalingFactors.data(), outScalings, numLanes);
+		break;
+
+	default:
+		LerpVec3Kernel<ScalarLane>(startPositions, endPositions, k.PositionFactors.data(), outPositions, numLanes);
+		LerpVec3Kernel<ScalarLane>(startScalings, endScalings, k.ScalingFactors.data(), outScalings, numLanes);
+		break;
+	}
+
+	s_QuatKernels[s_Kernel][m_Clip->GetRotationMode()](startRotations, endRotations, k.RotationFactors.data(), outRotations, numLanes);
+
+	// scatter the channels back to the nodes they animate
+	for (unsigned int i = 0; i < numChannels; i++)
+	{
+		unsigned int nodeIndex = m_Clip->GetChannelNode(m_Channels[i]);
+
+		pose.PositionX[nodeIndex] = out.PositionX[i]; pose.PositionY[nodeIndex] = out.PositionY[i]; pose.PositionZ[nodeIndex] = out.PositionZ[i];
+		pose.RotationX[nodeIndex] = out.RotationX[i]; pose.RotationY[nodeIndex] = out.RotationY[i];
+		pose.RotationZ[nodeIndex] = out.RotationZ[i]; pose.RotationW[nodeIndex] = out.RotationW[i];
+		pose.ScalingX[nodeIndex] = out.ScalingX[i]; pose.ScalingY[nodeIndex] = out.ScalingY[i]; pose.ScalingZ[nodeIndex] = out.ScalingZ[i];
+	}
+}
+
+void AnimationSampler::GatherKeys(float animationTimeInTicks, unsigned int numChannels)
+{
+	StagedKeys& k = m_Staged;
+
+	for (unsigned int i = 0; i < numChannels; i++)
+	{
+		const AnimationChannel& channel = m_Clip->GetChannel(m_Channels[i]);
+		KeyCursors& cursors = m_KeyCursors[i];
+
+		glm::vec3 startPosition, endPosition;
+		if (channel.PositionTimes.size() == 1)
+		{
+			startPosition = endPosition = channel.GetPosition(0);
+			k.PositionFactors[i] = 0.0f;
+		}
+		else
+		{
+			unsigned int positionIndex = FindPosition(animationTimeInTicks, channel, cursors.Position);
+			startPosition = channel.GetPosition(positionIndex);
+			endPosition = channel.GetPosition(positionIndex + 1);
+			k.PositionFactors[i] = CalcFactor(channel.PositionTimes, positionIndex, animationTimeInTicks);
+		}
+		k.StartPositionX[i] = startPosition.x; k.StartPositionY[i] = startPosition.y; k.StartPositionZ[i] = startPosition.z;
+		k.EndPositionX[i] = endPosition.x; k.EndPositionY[i] = endPosition.y; k.EndPositionZ[i] = endPosition.z;
+
+		glm::quat startRotation, endRotation;
+		if (channel.RotationTimes.size() == 1)
+		{
+			startRotation = endRotation = channel.GetRotation(0);
+			k.RotationFactors[i] = 0.0f;
+		}
+		else
+		{
+			unsigned int rotationIndex = FindRotation(animationTimeInTicks, channel, cursors.Rotation);
+			startRotation = channel.GetRotation(rotationIndex);
+			endRotation = channel.GetRotation(rotationIndex + 1);
+			k.RotationFactors[i] = CalcFactor(channel.RotationTimes, rotationIndex, animationTimeInTicks);
+		}
+		k.StartRotationX[i] = startRotation.x; k.StartRotationY[i] = startRotation.y; k.StartRotationZ[i] = startRotation.z; k.StartRotationW[i] = startRotation.w;
+		k.EndRotationX[i] = endRotation.x; k.EndRotationY[i] = endRotation.y; k.EndRotationZ[i] = endRotation.z; k.EndRotationW[i] = endRotation.w;
+
+		glm::vec3 startScaling, endScaling;
+		if (channel.ScalingTimes.size() == 1)
+		{
+			startScaling = endScaling = channel.GetScaling(0);
+			k.ScalingFactors[i] = 0.0f;
+		}
+		else
+		{
+			unsigned int scalingIndex = FindScaling(animationTimeInTicks, channel, cursors.Scaling);
+			startScaling = channel.GetScaling(scalingIndex);
+			endScaling = channel.GetScaling(scalingIndex + 1);
+			k.ScalingFactors[i] = CalcFactor(channel.ScalingTimes, scalingIndex, animationTimeInTicks);
+		}
+		k.StartScalingX[i] = startScaling.x; k.StartScalingY[i] = startScaling.y; k.StartScalingZ[i] = startScaling.z;
+		k.EndScalingX[i] = endScaling.x; k.EndScalingY[i] = endScaling.y; k.EndScalingZ[i] = endScaling.z;
+	}
+}
+
+unsigned int AnimationSampler::FindScaling(float animationTimeInTicks, const AnimationChannel& channel, unsigned int& cursor)
+{
+	if (m_Clip->IsUniform())
+		return m_Clip->FindUniformKey(animationTimeInTicks);
+
+	return FindKeyIndex(channel.ScalingTimes.data(), (unsigned int)channel.ScalingTimes.size(), animationTimeInTicks, m_UseKeyCursors ? &cursor : nullptr);
+}
+
+unsigned int AnimationSampler::FindRotation(float animationTimeInTicks, const AnimationChannel& channel, unsigned int& cursor)
+{
+	if (m_Clip->IsUniform())
+		return m_Clip->FindUniformKey(animationTimeInTicks);
+
+	return FindKeyIndex(channel.RotationTimes.data(), (unsigned int)channel.RotationTimes.size(), animationTimeInTicks, m_UseKeyCursors ? &cursor : nullptr);
+}
+
+unsigned int AnimationSampler::FindPosition(float animationTimeInTicks, const AnimationChannel& channel, unsigned int& cursor)
+{
+	if (m_Clip->IsUniform())
+		return m_Clip->FindUniformKey(animationTimeInTicks);
+
+	return FindKeyIndex(channel.PositionTimes.data(), (unsigned int)channel.PositionTimes.size(), animationTimeInTicks, m_UseKeyCursors ? &cursor : nullptr);
+}
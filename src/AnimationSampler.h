@@ -0,0 +1,100 @@
+#pragma once
+
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+#include <vector>
+
+#include "AlignedAllocator.h"
+#include "AnimationClip.h"
+#include "Pose.h"
+#include "Skeleton.h"
+
+enum SamplerKernel
+{
+	SCALAR_KERNEL	= 0,
+	SSE_KERNEL		= 1,
+	AVX2_KERNEL		= 2
+};
+
+// Samples every channel of a clip into a LocalPose.
+// Keys are first found and decoded per channel into SoA staging arrays, then interpolated
+// 1, 4 or 8 channels at a time by the kernel picked at runtime.
+// Holds per instance state (key cursors), so every animated instance needs its own sampler
+class AnimationSampler
+{
+public:
+	AnimationSampler() {};
+
+	// nodeWeights (one per skeleton node, e.g. a bone mask) restricts sampling to the channels of nodes
+	// with a weight above zero. Skipped channels cost nothing per frame and leave their nodes untouched.
+	// nodeLODs (Skeleton::GetNodeLODs) orders the channels so each skeleton LOD samples a prefix of them
+	// Binding never allocates once the buffers hold the clip's channels, Reserve sizes them up front
+	void Bind(const AnimationClip* clip, const float* nodeWeights = nullptr, const unsigned char* nodeLODs = nullptr);
+	void Reserve(unsigned int maxChannels);
+	void Sample(float animationTimeInTicks, LocalPose& pose, unsigned int lod = 0);
+
+	unsigned int GetNumSampledChannels(unsigned int lod = 0) const { return m_LODChannelCounts[lod]; }
+
+	// Start keyframe searches from the last key found instead of a fresh binary search
+	void SetUseKeyCursors(bool useKeyCursors) { m_UseKeyCursors = useKeyCursors; }
+
+	// Kernel used by all samplers. Requests for an ISA the CPU lacks fall back to the best supported one
+	static void SetKernel(SamplerKernel kernel);
+	static SamplerKernel GetKernel() { return s_Kernel; }
+	static SamplerKernel GetBestKernel();
+
+	// out = mix(a, b, weights[node]) per node, with the same kernel as sampling.
+	// weights must hold one entry per padded pose lane (a multiple of 8). out may be the same pose as a
+	static void BlendPoses(const LocalPose& a, const LocalPose& b, const float* weights, LocalPose& out);
+
+	// Layers an additive pose (sampled from an additive clip) on top of base, scaled by weights[node].
+	// out may be the same pose as base
+	static void AddPoses(const LocalPose& base, const LocalPose& additive, const float* weights, LocalPose& out);
+
+private:
+	void GatherKeys(float animationTimeInTicks, unsigned int numChannels);
+
+	unsigned int FindScaling(float animationTimeInTicks, const AnimationChannel& channel, unsigned int& cursor);
+	unsigned int FindRotation(float animationTimeInTicks, const AnimationChannel& channel, unsigned int& cursor);
+	unsigned int FindPosition(float animationTimeInTicks, const AnimationChannel& channel, unsigned int& cursor);
+
+	// Last key index found per clip channel, so forward playback doesn't search at all
+	struct KeyCursors
+	{
+		unsigned int Scaling = 0;
+		unsigned int Rotation = 0;
+		unsigned int Position = 0;
+	};
+
+	// Start key, end key and interpolation factor of every sampled channel, padded to a multiple of 8
+	struct StagedKeys
+	{
+		AlignedVector<float> StartPositionX, StartPositionY, StartPositionZ;
+		AlignedVector<float> EndPositionX, EndPositionY, EndPositionZ;
+		AlignedVector<float> PositionFactors;
+
+		AlignedVector<float> StartRotationX, StartRotationY, StartRotationZ, StartRotationW;
+		AlignedVector<float> EndRotationX, EndRotationY, EndRotationZ, EndRotationW;
+		AlignedVector<float> RotationFactors;
+
+		AlignedVector<float> StartScalingX, StartScalingY, StartScalingZ;
+		AlignedVector<float> EndScalingX, EndScalingY, EndScalingZ;
+		AlignedVector<float> ScalingFactors;
+
+		void Resize(unsigned int paddedSize);
+	};
+
+private:
+	const AnimationClip* m_Clip = nullptr;
+
+	std::vector<unsigned int> m_Channels;	// clip channels sampled, in lane order, highest LOD nodes first
+	unsigned int m_LODChannelCounts[MAX_SKELETON_LODS] = { 0 };
+	std::vector<KeyCursors> m_KeyCursors;	// per sampled channel
+	bool m_UseKeyCursors = true;
+
+	unsigned int m_NumLanes = 0;
+	StagedKeys m_Staged;
+	LocalPose m_ChannelPose;	// kernel output, indexed by lane
+
+	static SamplerKernel s_Kernel;
+};
@@ -0,0 +1,58 @@
+// Compiled with AVX2 code generation, see the vectorextensions filter in premake5.lua.
+// Only reached after AnimationSampler has checked CPUID, and kept free of glm/std headers
+// so no AVX2 encoded inline function can leak into the rest of the program.
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC target("avx2")
+#endif
+
+#include "SamplerKernels.h"
+
+struct AVX2Lane
+{
+	typedef __m256 Type;
+	static const unsigned int Width = 8;
+
+	static __m256 Load(const float* p) { return _mm256_load_ps(p); }
+	static void Store(float* p, __m256 v) { _mm256_store_ps(p, v); }
+	static __m256 Set1(float v) { return _mm256_set1_ps(v); }
+	static __m256 Add(__m256 a, __m256 b) { return _mm256_add_ps(a, b); }
+	static __m256 Sub(__m256 a, __m256 b) { return _mm256_sub_ps(a, b); }
+	static __m256 Mul(__m256 a, __m256 b) { return _mm256_mul_ps(a, b); }
+	static __m256 Div(__m256 a, __m256 b) { return _mm256_div_ps(a, b); }
+	static __m256 Min(__m256 a, __m256 b) { return _mm256_min_ps(a, b); }
+	static __m256 Abs(__m256 a) { return _mm256_andnot_ps(_mm256_set1_ps(-0.0f), a); }
+	static __m256 Sqrt(__m256 a) { return _mm256_sqrt_ps(a); }
+	static __m256 MulSign(__m256 a, __m256 sign) { return _mm256_xor_ps(a, _mm256_and_ps(sign, _mm256_set1_ps(-0.0f))); }
+	static __m256 CmpGt(__m256 a, __m256 b) { return _mm256_cmp_ps(a, b, _CMP_GT_OQ); }
+	static __m256 Select(__m256 mask, __m256 a, __m256 b) { return _mm256_blendv_ps(b, a, mask); }
+};
+
+void LerpVec3AVX2(const Vec3Stream& start, const Vec3Stream& end, const float* factors, const Vec3Stream& out, unsigned int count)
+{
+	LerpVec3Kernel<AVX2Lane>(start, end, factors, out, count);
+}
+
+void SlerpQuatAVX2(const QuatStream& start, const QuatStream& end, const float* factors, const QuatStream& out, unsigned int count)
+{
+	SlerpQuatKernel<AVX2Lane>(start, end, factors, out, count);
+}
+
+void NlerpQuatAVX2(const QuatStream& start, const QuatStream& end, const float* factors, const QuatStream& out, unsigned int count)
+{
+	NlerpQuatKernel<AVX2Lane>(start, end, factors, out, count);
+}
+
+void ApproxSlerpQuatAVX2(const QuatStream& start, const QuatStream& end, const float* factors, const QuatStream& out, unsigned int count)
+{
+	ApproxSlerpQuatKernel<AVX2Lane>(start, end, factors, out, count);
+}
+
+void BlendPoseAVX2(const PoseStream& a, const PoseStream& b, const float* weights, const PoseStream& out, unsigned int count)
+{
+	BlendPoseKernel<AVX2Lane>(a, b, weights, out, count);
+}
+
+void AddPoseAVX2(const PoseStream& base, const PoseStream& delta, const float* weights, const PoseStream& out, unsigned int count)
+{
+	AddPoseKernel<AVX2Lane>(base, delta, weights, out, count);
+}
@@ -0,0 +1,195 @@
+#include "AnimationStateMachine.h"
+
+#include <assert.h>
+#include <float.h>
+#include <stdio.h>
+#include <algorithm>
+
+unsigned int AnimationStateMachine::AddParameter(const std::string& name)
+{
+	assert(m_ParameterNames.size() < MAX_STATE_MACHINE_PARAMETERS);
+
+	m_ParameterNames.push_back(name);
+	return (unsigned int)m_ParameterNames.size() - 1;
+}
+
+int AnimationStateMachine::FindParameter(const std::string& name) const
+{
+	auto it = std::find(m_ParameterNames.begin(), m_ParameterNames.end(), name);
+	return it != m_ParameterNames.end() ? (int)(it - m_ParameterNames.begin()) : -1;
+}
+
+unsigned int AnimationStateMachine::AddClipState(const std::string& name, unsigned int clipIndex)
+{
+	AnimationStateNode state = {};
+	state.Type = CLIP_STATE;
+	state.Index = clipIndex;
+
+	m_States.push_back(state);
+	m_StateNames.push_back(name);
+	m_Compiled = false;
+
+	return (unsigned int)m_States.size() - 1;
+}
+
+unsigned int AnimationStateMachine::AddBlendSpaceState(const std::string& name, unsigned int blendSpaceIndex, unsigned int xParameter, unsigned int yParameter)
+{
+	assert(xParameter < MAX_STATE_MACHINE_PARAMETERS && yParameter < MAX_STATE_MACHINE_PARAMETERS);
+
+	AnimationStateNode state = {};
+	state.Type = BLEND_SPACE_STATE;
+	state.Index = blendSpaceIndex;
+	state.XParameter = xParameter;
+	state.YParameter = yParameter;
+
+	m_States.push_back(state);
+	m_StateNames.push_back(name);
+	m_Compiled = false;
+
+	return (unsigned int)m_States.size() - 1;
+}
+
+int AnimationStateMachine::FindState(const std::string& name) const
+{
+	auto it = std::find(m_StateNames.begin(), m_StateNames.end(), name);
+	return it != m_StateNames.end() ? (int)(it - m_StateNames.begin()) : -1;
+}
+
+unsigned int AnimationStateMachine::AddTransition(int fromState, unsigned int toState, float blendDuration, float exitTime)
+{
+	AuthoredTransition authored;
+	authored.FromState = fromState;
+	authored.Transition = {};
+	authored.Transition.TargetState = toState;
+	authored.Transition.BlendDuration = blendDuration;
+	authored.Transition.ExitTime = exitTime;
+
+	m_AuthoredTransitions.push_back(authored);
+	m_Compiled = false;
+
+	return (unsigned int)m_AuthoredTransitions.size() - 1;
+}
+
+void AnimationStateMachine::AddCondition(unsigned int transitionIndex, unsigned int parameter, ConditionComparison comparison, float threshold)
+{
+	assert(parameter < m_ParameterNames.size());
+
+	m_AuthoredTransitions[transitionIndex].Conditions.push_back({ parameter, comparison, threshold });
+	m_Compiled = false;
+}
+
+bool AnimationStateMachine::Compile()
+{
+	if (m_States.empty() || m_States.size() > 0xFFFF)
+	{
+		printf("State machine needs between 1 and 65535 states, has %u\n", (unsigned int)m_States.size());
+		return false;
+	}
+
+	for (const AuthoredTransition& authored : m_AuthoredTransitions)
+	{
+		if (authored.FromState >= (int)m_States.size() || authored.Transition.TargetState >= m_States.size())
+		{
+			printf("State machine transition %d -> %u references a missing state\n", authored.FromState, authored.Transition.TargetState);
+			return false;
+		}
+	}
+
+	m_Transitions.clear();
+	m_Conditions.clear();
+
+	// a state's own transitions first, then the any state ones that don't lead back to it
+	for (unsigned int stateIndex = 0; stateIndex < m_States.size(); stateIndex++)
+	{
+		AnimationStateNode& state = m_States[stateIndex];
+		state.FirstTransition = (unsigned int)m_Transitions.size();
+		state.MinExitTime = FLT_MAX;
+
+		for (int pass = 0; pass < 2; pass++)
+		{
+			for (const AuthoredTransition& authored : m_AuthoredTransitions)
+			{
+				bool fromThisState = pass == 0 ? authored.FromState == (int)stateIndex :
+					authored.FromState == ANY_STATE && authored.Transition.TargetState != stateIndex;
+
+				if (!fromThisState)
+					continue;
+
+				AnimationTransition transition = authored.Transition;
+				transition.FirstCondition = (unsigned int)m_Conditions.size();
+				transition.NumConditions = (unsigned int)authored.Conditions.size();
+				m_Conditions.insert(m_Conditions.end(), authored.Conditions.begin(), authored.Conditions.end());
+				m_Transitions.push_back(transition);
+
+				if (transition.ExitTime > 0.0f)
+					state.MinExitTime = std::min(state.MinExitTime, transition.ExitTime);
+			}
+		}
+
+		state.NumTransitions = (unsigned int)m_Transitions.size() - state.FirstTransition;
+	}
+
+	m_Compiled = true;
+
+	unsigned int sharedBytes = (unsigned int)(m_States.size() * sizeof(AnimationStateNode) +
+		m_Transitions.size() * sizeof(AnimationTransition) + m_Conditions.size() * sizeof(AnimationCondition));
+
+	printf("State machine: %u states, %u transitions, %u bytes shared, %u bytes per instance\n",
+		(unsigned int)m_States.size(), (unsigned int)m_Transitions.size(), sharedBytes, (unsigned int)sizeof(AnimationStateInstance));
+
+	return true;
+}
+
+void AnimationStateMachine::Reset(AnimationStateInstance& instance, double timeInSeconds) const
+{
+	instance.CurrentState = 0;
+	instance.StateStartTime = timeInSeconds;
+	instance.ParametersDirty = true;
+}
+
+bool AnimationStateMachine::EvaluateConditions(const AnimationTransition& transition, const AnimationStateInstance& instance) const
+{
+	for (unsigned int i = 0; i < transition.NumConditions; i++)
+	{
+		const AnimationCondition& condition = m_Conditions[transition.FirstCondition + i];
+		float value = instance.Parameters[condition.Parameter];
+
+		bool holds = condition.Comparison == GREATER_THAN ? value > condition.Threshold : value < condition.Threshold;
+		if (!holds)
+			return false;
+	}
+
+	return true;
+}
+
+const AnimationTransition* AnimationStateMachine::Update(AnimationStateInstance& instance, double timeInSeconds) const
+{
+	assert(m_Compiled);
+
+	const AnimationStateNode& state = m_States[instance.CurrentState];
+	float stateTime = (float)(timeInSeconds - instance.StateStartTime);
+
+	// conditions only read parameters, so nothing new can pass until one changes or an exit time is reached
+	if (!instance.ParametersDirty && stateTime < state.MinExitTime)
+		return nullptr;
+
+	instance.ParametersDirty = false;
+
+	for (unsigned int i = 0; i < state.NumTransitions; i++)
+	{
+		const AnimationTransition& transition = m_Transitions[state.FirstTransition + i];
+
+		if (stateTime < transition.ExitTime || !EvaluateConditions(transition, instance))
+			continue;
+
+		instance.CurrentState = (unsigned short)transition.TargetState;
+		instance.StateStartTime = timeInSeconds;
+
+		// the new state's transitions haven't been tested against the current parameters yet
+		instance.ParametersDirty = true;
+
+		return &transition;
+	}
+
+	return nullptr;
+}
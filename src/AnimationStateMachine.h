@@ -0,0 +1,118 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#define MAX_STATE_MACHINE_PARAMETERS 8
+#define ANY_STATE -1
+
+enum AnimationStateType
+{
+	CLIP_STATE			= 0,
+	BLEND_SPACE_STATE	= 1
+};
+
+enum ConditionComparison
+{
+	GREATER_THAN	= 0,
+	LESS_THAN		= 1
+};
+
+struct AnimationCondition
+{
+	unsigned int Parameter;
+	ConditionComparison Comparison;
+	float Threshold;
+};
+
+// Transitions of a state are contiguous, and so are the conditions of a transition
+struct AnimationTransition
+{
+	unsigned int TargetState;
+	float BlendDuration;
+	float ExitTime;					// seconds in the source state before it may fire, 0 for none
+	unsigned int FirstCondition;
+	unsigned int NumConditions;
+};
+
+struct AnimationStateNode
+{
+	AnimationStateType Type;
+	unsigned int Index;				// clip or blend space index on the mesh
+	unsigned int XParameter;		// blend space parameters
+	unsigned int YParameter;
+	unsigned int FirstTransition;
+	unsigned int NumTransitions;
+	float MinExitTime;				// no transition can fire before this unless a parameter changes
+};
+
+// Everything a character playing a state machine owns, the graph itself is shared
+struct AnimationStateInstance
+{
+	double StateStartTime = 0.0;
+	float Parameters[MAX_STATE_MACHINE_PARAMETERS] = { 0.0f };
+	unsigned short CurrentState = 0;
+	bool ParametersDirty = true;
+
+	void SetParameter(unsigned int parameter, float value)
+	{
+		if (Parameters[parameter] != value)
+		{
+			Parameters[parameter] = value;
+			ParametersDirty = true;
+		}
+	}
+};
+
+// States playing a clip or a blend space, linked by transitions with parameter conditions and a
+// blend duration. Authored with the Add* calls, then compiled into flat state, transition and
+// condition arrays that any number of instances evaluate without virtual calls or allocations
+class AnimationStateMachine
+{
+public:
+	AnimationStateMachine() {};
+
+	unsigned int AddParameter(const std::string& name);
+	int FindParameter(const std::string& name) const;
+
+	// The first state added is the entry state
+	unsigned int AddClipState(const std::string& name, unsigned int clipIndex);
+	unsigned int AddBlendSpaceState(const std::string& name, unsigned int blendSpaceIndex, unsigned int xParameter, unsigned int yParameter = 0);
+	int FindState(const std::string& name) const;
+
+	// fromState may be ANY_STATE. Transitions are tested in the order they were added, any state ones last
+	unsigned int AddTransition(int fromState, unsigned int toState, float blendDuration, float exitTime = 0.0f);
+	void AddCondition(unsigned int transitionIndex, unsigned int parameter, ConditionComparison comparison, float threshold);
+
+	bool Compile();
+
+	unsigned int GetNumStates() const { return (unsigned int)m_States.size(); }
+	const AnimationStateNode& GetState(unsigned int stateIndex) const { return m_States[stateIndex]; }
+
+	void Reset(AnimationStateInstance& instance, double timeInSeconds) const;
+
+	// Moves the instance along the first transition whose conditions hold and returns it, or nullptr.
+	// States are only re-tested after a parameter changed or once an exit time may have passed
+	const AnimationTransition* Update(AnimationStateInstance& instance, double timeInSeconds) const;
+
+private:
+	struct AuthoredTransition
+	{
+		int FromState;
+		AnimationTransition Transition;
+		std::vector<AnimationCondition> Conditions;
+	};
+
+	bool EvaluateConditions(const AnimationTransition& transition, const AnimationStateInstance& instance) const;
+
+private:
+	std::vector<std::string> m_ParameterNames;
+	std::vector<std::string> m_StateNames;
+	std::vector<AuthoredTransition> m_AuthoredTransitions;
+
+	// compiled graph
+	std::vector<AnimationStateNode> m_States;
+	std::vector<AnimationTransition> m_Transitions;
+	std::vector<AnimationCondition> m_Conditions;
+	bool m_Compiled = false;
+};
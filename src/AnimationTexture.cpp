@@ -0,0 +1,128 @@
+#include "AnimationTexture.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include "SkinnedMesh.h"
+
+AnimationTexture::~AnimationTexture()
+{
+	Clear();
+}
+
+void AnimationTexture::Clear()
+{
+	if (m_Texture)
+		glDeleteTextures(1, &m_Texture);
+	if (m_Buffer)
+		glDeleteBuffers(1, &m_Buffer);
+
+	m_Texture = 0;
+	m_Buffer = 0;
+	m_NumFrames = 0;
+	m_Clips.clear();
+}
+
+bool AnimationTexture::Bake(const SkinnedMesh& mesh, float framesPerSecond, JobSystem* jobSystem)
+{
+	Clear();
+
+	m_FramesPerSecond = framesPerSecond;
+	m_NumBones = (unsigned int)mesh.GetNumBones();
+
+	for (unsigned int i = 0; i < mesh.GetNumClips(); i++)
+	{
+		const AnimationClip& clip = mesh.GetClip(i);
+		double durationInSeconds = clip.GetDuration() / clip.GetTicksPerSecond();
+
+		BakedClip baked;
+		baked.FirstFrame = m_NumFrames;
+		baked.Duration = (float)(durationInSeconds * framesPerSecond);
+		baked.NumFrames = (unsigned int)ceil(baked.Duration) + 1;
+
+		m_Clips.push_back(baked);
+		m_NumFrames += baked.NumFrames;
+	}
+
+	GLint maxTexels = 0;
+	glGetIntegerv(GL_MAX_TEXTURE_BUFFER_SIZE, &maxTexels);
+
+	size_t numTexels = (size_t)m_NumFrames * m_NumBones * 3;
+	if (numTexels == 0 || numTexels > (size_t)maxTexels)
+	{
+		printf("Can't bake %u frames of %u bones, texture buffers hold %d texels\n", m_NumFrames, m_NumBones, maxTexels);
+		m_Clips.clear();
+		m_NumFrames = 0;
+		return false;
+	}
+
+	std::vector<glm::vec4> texels(numTexels);
+
+	std::vector<unsigned int> frameClips(m_NumFrames);
+	for (unsigned int i = 0; i < m_Clips.size(); i++)
+		std::fill_n(frameClips.begin() + m_Clips[i].FirstFrame, m_Clips[i].NumFrames, i);
+
+	// frames are independent, each worker evaluates into its own scratch and palette
+	unsigned int numWorkers = jobSystem ? jobSystem->GetNumWorkers() : 1;
+	std::vector<SkinnedMesh::ClipEvaluationScratch> scratches(numWorkers);
+	std::vector<std::vector<glm::mat4>> palettes(numWorkers, std::vector<glm::mat4>(m_NumBones));
+
+	for (SkinnedMesh::ClipEvaluationScratch& scratch : scratches)
+		mesh.InitClipScratch(scratch);
+
+	ParallelFor(jobSystem, m_NumFrames, 8, [&](unsigned int begin, unsigned int end, unsigned int workerIndex)
+	{
+		std::vector<glm::mat4>& transforms = palettes[workerIndex];
+
+		for (unsigned int frameIndex = begin; frameIndex < end; frameIndex++)
+		{
+			unsigned int clipIndex = frameClips[frameIndex];
+			const AnimationClip& clip = mesh.GetClip(clipIndex);
+			unsigned int frame = frameIndex - m_Clips[clipIndex].FirstFrame;
+
+			// the last frame lands exactly on the end instead of wrapping back to the first
+			float ticks = glm::min((float)(frame / (double)framesPerSecond * clip.GetTicksPerSecond()), clip.GetDuration());
+			mesh.EvaluateClipBoneTransforms(clipIndex, ticks, 0, scratches[workerIndex], transforms.data());
+
+			glm::vec4* rows = &texels[(size_t)frameIndex * m_NumBones * 3];
+			for (unsigned int bone = 0; bone < m_NumBones; bone++)
+			{
+				const glm::mat4& m = transforms[bone];
+				for (int r = 0; r < 3; r++)
+					rows[bone * 3 + r] = glm::vec4(m[0][r], m[1][r], m[2][r], m[3][r]);
+			}
+		}
+	});
+
+	glGenBuffers(1, &m_Buffer);
+	glBindBuffer(GL_TEXTURE_BUFFER, m_Buffer);
+	glBufferData(GL_TEXTURE_BUFFER, texels.size() * sizeof(glm::vec4), texels.data(), GL_STATIC_DRAW);
+
+	glGenTextures(1, &m_Texture);
+	glBindTexture(GL_TEXTURE_BUFFER, m_Texture);
+	glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, m_Buffer);
+
+	glBindTexture(GL_TEXTURE_BUFFER, 0);
+	glBindBuffer(GL_TEXTURE_BUFFER, 0);
+
+	printf("Baked %u clips into %u frames, %zu KB\n", (unsigned int)m_Clips.size(), m_NumFrames, GetMemoryUsage() / 1024);
+
+	return true;
+}
+
+void AnimationTexture::SetActive(int slot) const
+{
+	glActiveTexture(GL_TEXTURE0 + slot);
+	glBindTexture(GL_TEXTURE_BUFFER, m_Texture);
+	glActiveTexture(GL_TEXTURE0);
+}
+
+BakedInstance AnimationTexture::MakeInstance(unsigned int clipIndex, double startTimeInSeconds, const glm::vec3& offset) const
+{
+	const BakedClip& clip = m_Clips[clipIndex];
+
+	BakedInstance instance;
+	instance.Animation = glm::vec4((float)clip.FirstFrame, clip.Duration, m_FramesPerSecond, (float)startTimeInSeconds);
+	instance.Offset = glm::vec4(offset, 0.0f);
+	return instance;
+}
@@ -0,0 +1,56 @@
+#pragma once
+
+#include <glm/glm.hpp>
+#include <glad/glad.h>
+#include <vector>
+
+class SkinnedMesh;
+class JobSystem;
+
+// Per instance vertex attributes for baked playback, the vertex shader derives the frame from uTime
+struct BakedInstance
+{
+	glm::vec4 Animation;	// first frame, clip duration in frames, frames per second, start time in seconds
+	glm::vec4 Offset;		// world space translation in xyz
+};
+
+struct BakedClip
+{
+	unsigned int FirstFrame;
+	unsigned int NumFrames;		// includes a last frame at the clip's end, so the shader never wraps inside a pair
+	float Duration;				// in frames, the last pair is shorter when this isn't a whole number
+};
+
+// Every clip of a mesh sampled at a fixed rate into a texture buffer of bone palettes.
+// Each bone of each frame takes three RGBA32F texels holding the rows of its 3x4 matrix,
+// so crowds play back on the GPU with no CPU animation work per instance
+class AnimationTexture
+{
+public:
+	AnimationTexture() {};
+	~AnimationTexture();
+
+	// Frames are evaluated as jobs when a job system is given
+	bool Bake(const SkinnedMesh& mesh, float framesPerSecond = 30.0f, JobSystem* jobSystem = nullptr);
+
+	// Binds the palette buffer for the uBakedBones sampler
+	void SetActive(int slot = 1) const;
+
+	unsigned int GetNumBones() const { return m_NumBones; }
+	unsigned int GetNumClips() const { return (unsigned int)m_Clips.size(); }
+	const BakedClip& GetClip(unsigned int clipIndex) const { return m_Clips[clipIndex]; }
+	size_t GetMemoryUsage() const { return (size_t)m_NumFrames * m_NumBones * 3 * sizeof(glm::vec4); }
+
+	BakedInstance MakeInstance(unsigned int clipIndex, double startTimeInSeconds, const glm::vec3& offset) const;
+
+private:
+	void Clear();
+
+private:
+	GLuint m_Buffer = 0;
+	GLuint m_Texture = 0;
+	float m_FramesPerSecond = 0.0f;
+	unsigned int m_NumBones = 0;
+	unsigned int m_NumFrames = 0;
+	std::vector<BakedClip> m_Clips;
+};
@@ -0,0 +1,25 @@
+#pragma once
+
+#include <glm/glm.hpp>
+#include <assimp/matrix4x4.h>
+#include <assimp/matrix3x3.h>
+
+inline glm::mat4 AiMatToGLM(const aiMatrix4x4& m)
+{
+	glm::mat4 r;
+	r[0][0] = m.a1; r[1][0] = m.a2; r[2][0] = m.a3; r[3][0] = m.a4;
+	r[0][1] = m.b1; r[1][1] = m.b2; r[2][1] = m.b3; r[3][1] = m.b4;
+	r[0][2] = m.c1; r[1][2] = m.c2; r[2][2] = m.c3; r[3][2] = m.c4;
+	r[0][3] = m.d1; r[1][3] = m.d2; r[2][3] = m.d3; r[3][3] = m.d4;
+	return r;
+}
+
+inline glm::mat4 AiMatToGLM(const aiMatrix3x3& m)
+{
+	glm::mat4 r(1.0f);
+	r[0][0] = m.a1; r[1][0] = m.a2; r[2][0] = m.a3;
+	r[0][1] = m.b1; r[1][1] = m.b2; r[2][1] = m.b3;
+	r[0][2] = m.c1; r[1][2] = m.c2; r[2][2] = m.c3;
+
+	return r;
+}
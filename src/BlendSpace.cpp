@@ -0,0 +1,113 @@
+#include "BlendSpace.h"
+
+#include <stdio.h>
+#include <math.h>
+#include <algorithm>
+
+#define MAX_AXIS_BUCKETS 1024
+
+bool BlendSpace::Axis::Init(const std::vector<float>& values)
+{
+	if (values.empty())
+		return false;
+
+	float minSegment = 0.0f;
+	for (unsigned int i = 1; i < values.size(); i++)
+	{
+		float segment = values[i] - values[i - 1];
+		if (segment <= 0.0f)
+			return false;
+
+		minSegment = i == 1 ? segment : std::min(minSegment, segment);
+	}
+
+	Values = values;
+	BucketSegments.assign(1, 0);
+	InvBucketSize = 0.0f;
+
+	if (values.size() < 2)
+		return true;
+
+	float range = values.back() - values.front();
+	unsigned int numBuckets = std::min((unsigned int)ceilf(range / minSegment), (unsigned int)MAX_AXIS_BUCKETS);
+	InvBucketSize = numBuckets / range;
+
+	// segment holding the start of each bucket
+	BucketSegments.resize(numBuckets);
+	unsigned int segment = 0;
+	for (unsigned int i = 0; i < numBuckets; i++)
+	{
+		float bucketStart = values.front() + i / InvBucketSize;
+		while (segment + 2 < values.size() && values[segment + 1] <= bucketStart)
+			segment++;
+
+		BucketSegments[i] = (unsigned short)segment;
+	}
+
+	return true;
+}
+
+unsigned int BlendSpace::Axis::FindSegment(float value, float& factor) const
+{
+	if (Values.size() < 2)
+	{
+		factor = 0.0f;
+		return 0;
+	}
+
+	value = std::min(std::max(value, Values.front()), Values.back());
+
+	unsigned int bucket = std::min((unsigned int)((value - Values.front()) * InvBucketSize), (unsigned int)BucketSegments.size() - 1);
+	unsigned int segment = BucketSegments[bucket];
+
+	// a bucket spans at most one segment boundary unless the bucket count was capped
+	while (segment + 2 < Values.size() && value >= Values[segment + 1])
+		segment++;
+
+	factor = (value - Values[segment]) / (Values[segment + 1] - Values[segment]);
+	return segment;
+}
+
+bool BlendSpace::Init1D(const std::vector<float>& xValues, const std::vector<unsigned int>& clipIndices)
+{
+	return Init2D(xValues, std::vector<float>(1, 0.0f), clipIndices);
+}
+
+bool BlendSpace::Init2D(const std::vector<float>& xValues, const std::vector<float>& yValues, const std::vector<unsigned int>& clipIndices)
+{
+	if (clipIndices.size() != xValues.size() * yValues.size() || !m_X.Init(xValues) || !m_Y.Init(yValues))
+	{
+		printf("Invalid blend space: %u clips for a %ux%u grid, values must be increasing\n",
+			(unsigned int)clipIndices.size(), (unsigned int)xValues.size(), (unsigned int)yValues.size());
+		return false;
+	}
+
+	m_ClipIndices = clipIndices;
+	return true;
+}
+
+unsigned int BlendSpace::FindContributions(float x, float y, BlendSpaceContribution* contributions) const
+{
+	float fx, fy;
+	unsigned int column = m_X.FindSegment(x, fx);
+	unsigned int row = m_Y.FindSegment(y, fy);
+	unsigned int numColumns = (unsigned int)m_X.Values.size();
+
+	// bilinear weights of the cell corners, corners with no weight aren't sampled at all
+	unsigned int count = 0;
+	for (unsigned int dy = 0; dy < 2; dy++)
+	{
+		for (unsigned int dx = 0; dx < 2; dx++)
+		{
+			float weight = (dx ? fx : 1.0f - fx) * (dy ? fy : 1.0f - fy);
+			if (weight <= 0.0f)
+				continue;
+
+			contributions[count].SampleIndex = (row + dy) * numColumns + column + dx;
+			contributions[count].Weight = weight;
+			count++;
+		}
+	}
+
+	return count;
+}
@@ -0,0 +1,51 @@
+#pragma once
+
+#include <vector>
+
+struct BlendSpaceContribution
+{
+	unsigned int SampleIndex;
+	float Weight;
+};
+
+// Clips placed on a 1D line or a 2D grid of parameter values (e.g. speed and direction).
+// Only holds the layout, the samplers playing it live with the instance.
+// A parameter lands in one segment per axis, so at most 2 (1D) or 4 (2D) samples contribute
+class BlendSpace
+{
+public:
+	static const unsigned int MAX_CONTRIBUTIONS = 4;
+
+	BlendSpace() {};
+
+	// clipIndices[i] is played at xValues[i]. Values must be increasing
+	bool Init1D(const std::vector<float>& xValues, const std::vector<unsigned int>& clipIndices);
+
+	// clipIndices[row * xValues.size() + column] is played at (xValues[column], yValues[row])
+	bool Init2D(const std::vector<float>& xValues, const std::vector<float>& yValues, const std::vector<unsigned int>& clipIndices);
+
+	unsigned int GetNumSamples() const { return (unsigned int)m_ClipIndices.size(); }
+	unsigned int GetSampleClip(unsigned int sampleIndex) const { return m_ClipIndices[sampleIndex]; }
+
+	// Writes the samples with a non-zero weight for (x, y) and returns their count. Weights sum to 1,
+	// parameters outside the grid are clamped to its border. Constant time, never allocates
+	unsigned int FindContributions(float x, float y, BlendSpaceContribution* contributions) const;
+
+private:
+	// Sample values along one axis, with a uniform bucket table mapping a value to its segment
+	// without a search. Buckets are no wider than the narrowest segment
+	struct Axis
+	{
+		std::vector<float> Values;
+		std::vector<unsigned short> BucketSegments;
+		float InvBucketSize = 0.0f;
+
+		bool Init(const std::vector<float>& values);
+		unsigned int FindSegment(float value, float& factor) const;
+	};
+
+private:
+	Axis m_X;
+	Axis m_Y;
+	std::vector<unsigned int> m_ClipIndices;
+};
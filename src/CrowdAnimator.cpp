@@ -0,0 +1,41 @@
+#include "CrowdAnimator.h"
+
+#include <assert.h>
+
+// Instances per job, enough to amortize scheduling without starving workers at the end of a batch
+#define CROWD_BATCH_SIZE 4
+
+CrowdAnimator::CrowdAnimator(JobSystem* jobSystem)
+	: m_JobSystem(jobSystem)
+{
+	m_Scratches.resize(jobSystem ? jobSystem->GetNumWorkers() : 1);
+}
+
+void CrowdAnimator::SetMesh(const SkinnedMesh* mesh)
+{
+	m_Mesh = mesh;
+	m_NumBones = (unsigned int)mesh->GetNumBones();
+
+	for (SkinnedMesh::ClipEvaluationScratch& scratch : m_Scratches)
+		mesh->InitClipScratch(scratch);
+}
+
+void CrowdAnimator::Update(const std::vector<CrowdInstance>& instances)
+{
+	assert(m_Mesh);
+
+	m_NumInstances = (unsigned int)instances.size();
+	m_Palettes.resize((size_t)m_NumInstances * m_NumBones);
+
+	ParallelFor(m_JobSystem, m_NumInstances, CROWD_BATCH_SIZE, [&](unsigned int begin, unsigned int end, unsigned int workerIndex)
+	{
+		SkinnedMesh::ClipEvaluationScratch& scratch = m_Scratches[workerIndex];
+
+		for (unsigned int i = begin; i < end; i++)
+		{
+			const CrowdInstance& instance = instances[i];
+			float ticks = m_Mesh->GetClip(instance.ClipIndex).GetAnimationTimeInTicks(instance.ClipTime);
+			m_Mesh->EvaluateClipBoneTransforms(instance.ClipIndex, ticks, instance.LOD, scratch, &m_Palettes[(size_t)i * m_NumBones]);
+		}
+	});
+}
@@ -0,0 +1,44 @@
+#pragma once
+
+#include <glm/glm.hpp>
+#include <vector>
+
+#include "SkinnedMesh.h"
+#include "JobSystem.h"
+
+// One character of a crowd sharing a mesh
+struct CrowdInstance
+{
+	unsigned int ClipIndex = 0;
+	double ClipTime = 0.0;		// seconds since the clip started, loops
+	unsigned int LOD = 0;		// skeleton LOD
+};
+
+// Evaluates the palettes of many characters sharing one SkinnedMesh as ParallelFor jobs.
+// Every instance owns a slot of GetNumBones() matrices in one buffer that exactly one job writes,
+// so palettes need no locks. Batches are small, so stealing evens out instances of uneven LODs
+class CrowdAnimator
+{
+public:
+	// nullptr evaluates every instance on the calling thread
+	CrowdAnimator(JobSystem* jobSystem);
+
+	// Binds every clip of the mesh for each worker. Call again after clips are added
+	void SetMesh(const SkinnedMesh* mesh);
+
+	// Blocks until every palette is written, the calling thread evaluates alongside the workers.
+	// The mesh must not change during the update
+	void Update(const std::vector<CrowdInstance>& instances);
+
+	unsigned int GetNumInstances() const { return m_NumInstances; }
+	const glm::mat4* GetPalette(unsigned int instanceIndex) const { return &m_Palettes[(size_t)instanceIndex * m_NumBones]; }
+
+private:
+	JobSystem* m_JobSystem;
+	const SkinnedMesh* m_Mesh = nullptr;
+	unsigned int m_NumBones = 0;
+
+	std::vector<SkinnedMesh::ClipEvaluationScratch> m_Scratches;	// per worker
+	unsigned int m_NumInstances = 0;
+	std::vector<glm::mat4> m_Palettes;
+};
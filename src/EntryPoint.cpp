@@ -10,6 +10,9 @@
 #include "Shader.h"
 #include "Mesh.h"
 #include "SkinnedMesh.h"
+#include "AnimationTexture.h"
+#include "CrowdAnimator.h"
+#include "JobSystem.h"
 
 #define SCREEN_WIDTH 1920
 #define SCREEN_HEIGHT 1080
@@ -46,8 +49,49 @@ int main(int argc, char* argv[])
 	glEnable(GL_DEPTH_TEST);
 
 	Shader shader("Assets/skinned.vert", "Assets/skinned.frag");
+	// shared by loading, baking and the crowd update, J prints how busy each worker was
+	JobSystem* jobSystem = new JobSystem();
+
 	SkinnedMesh* mesh = new SkinnedMesh();
-	mesh->LoadMesh(filename);
+	mesh->SetJobSystem(jobSystem);
+
+	AnimationImportSettings importSettings;
+	importSettings.ResampleRate = 30.0f;
+	importSettings.RotationMode = NLERP_ROTATION;
+	importSettings.Compress = true;
+	mesh->LoadMesh(filename, importSettings);
+
+	// a grid of instances played from baked bone palettes, toggled with B
+	AnimationTexture* animationTexture = new AnimationTexture();
+	bool showBakedCrowd = false;
+	if (mesh->GetNumClips() > 0 && animationTexture->Bake(*mesh, 30.0f, jobSystem))
+	{
+		std::vector<BakedInstance> instances;
+		for (int x = -5; x < 5; x++)
+		{
+			for (int z = 0; z < 10; z++)
+				instances.push_back(animationTexture->MakeInstance((x + 5 + z) % mesh->GetNumClips(), (x * 7 + z * 3) * 0.1, glm::vec3(x * 20.0f, 0, -z * 20.0f)));
+		}
+		mesh->SetBakedInstances(instances);
+	}
+
+	// the same grid evaluated on the CPU across worker threads, toggled with M
+	CrowdAnimator* crowdAnimator = new CrowdAnimator(jobSystem);
+	crowdAnimator->SetMesh(mesh);
+	std::vector<CrowdInstance> crowdInstances;
+	std::vector<glm::vec3> crowdOffsets;
+	bool showCpuCrowd = false;
+	for (int x = -5; x < 5 && mesh->GetNumClips() > 0; x++)
+	{
+		for (int z = 0; z < 10; z++)
+		{
+			CrowdInstance instance;
+			instance.ClipIndex = (x + 5 + z) % mesh->GetNumClips();
+			instance.LOD = glm::min(z / 3u, MAX_SKELETON_LODS - 1u);
+			crowdInstances.push_back(instance);
+			crowdOffsets.push_back(glm::vec3(x * 20.0f, 0, -z * 20.0f));
+		}
+	}
 
 	glm::mat4 projection = glm::perspective(glm::radians(80.0f), SCREEN_WIDTH / (float)(SCREEN_HEIGHT), 0.1f, 1000.0f);
 	glm::mat4 view = glm::lookAt(glm::vec3(0, 0, 15), glm::vec3(0), glm::vec3(0, 1.0f, 0));
@@ -83,18 +127,80 @@ int main(int argc, char* argv[])
 
 		shader.SetInt("uActiveBoneId", activeBoneId);
 
-		//model = glm::rotate(model, glm::radians(0.05f), glm::vec3(0, 1, 0));
+		static bool wasClipPressed;
+		bool isClipPressed = glfwGetKey(window, GLFW_KEY_C) == GLFW_PRESS;
+		if (!wasClipPressed && isClipPressed && mesh->GetNumClips() > 0)
+			mesh->CrossFade((mesh->GetActiveClip() + 1) % mesh->GetNumClips(), currentTime, 0.3f);
+		wasClipPressed = isClipPressed;
 
-		std::vector <glm::mat4> boneTransforms;
-		mesh->GetBoneTransforms(currentTime, boneTransforms);
-		shader.SetMat4s("uBones", boneTransforms);
+		//model = glm::rotate(model, glm::radians(0.05f), glm::vec3(0, 1, 0));
 
-		mesh->Render();
+		static bool wasBakedPressed;
+		bool isBakedPressed = glfwGetKey(window, GLFW_KEY_B) == GLFW_PRESS;
+		if (!wasBakedPressed && isBakedPressed && animationTexture->GetNumClips() > 0)
+			showBakedCrowd = !showBakedCrowd;
+		wasBakedPressed = isBakedPressed;
+
+		static bool wasCrowdPressed;
+		bool isCrowdPressed = glfwGetKey(window, GLFW_KEY_M) == GLFW_PRESS;
+		if (!wasCrowdPressed && isCrowdPressed && !crowdInstances.empty())
+			showCpuCrowd = !showCpuCrowd;
+		wasCrowdPressed = isCrowdPressed;
+
+		static bool wasStatsPressed;
+		bool isStatsPressed = glfwGetKey(window, GLFW_KEY_J) == GLFW_PRESS;
+		if (!wasStatsPressed && isStatsPressed)
+		{
+			jobSystem->PrintStats();
+			jobSystem->ResetStats();
+		}
+		wasStatsPressed = isStatsPressed;
+
+		shader.SetBool("uUseBakedBones", showBakedCrowd);
+
+		if (showBakedCrowd)
+		{
+			shader.SetInt("uBakedBones", 1);
+			shader.SetInt("uNumBakedBones", animationTexture->GetNumBones());
+			shader.SetFloat("uTime", (float)currentTime);
+			animationTexture->SetActive(1);
+
+			mesh->RenderInstanced();
+		}
+		else if (showCpuCrowd)
+		{
+			for (unsigned int i = 0; i < crowdInstances.size(); i++)
+				crowdInstances[i].ClipTime = currentTime + i * 0.37;
+			crowdAnimator->Update(crowdInstances);
+
+			std::vector<glm::mat4> boneTransforms(mesh->GetNumBones());
+			for (unsigned int i = 0; i < crowdInstances.size(); i++)
+			{
+				const glm::mat4* palette = crowdAnimator->GetPalette(i);
+				boneTransforms.assign(palette, palette + boneTransforms.size());
+				shader.SetMat4s("uBones", boneTransforms);
+				glm::mat4 instanceModel = glm::translate(glm::mat4(1), crowdOffsets[i]) * model;
+				shader.SetMat4("uModel", instanceModel);
+
+				mesh->Render();
+			}
+		}
+		else
+		{
+			std::vector <glm::mat4> boneTransforms;
+			mesh->GetBoneTransforms(currentTime, boneTransforms);
+			shader.SetMat4s("uBones", boneTransforms);
+
+			mesh->Render();
+		}
 
 		glfwSwapBuffers(window);
 		glfwPollEvents();
 	}
 
+	delete crowdAnimator;
+	delete jobSystem;
+
 	glfwTerminate();
 	return 0;
 
@@ -0,0 +1,227 @@
+#include "JobSystem.h"
+
+#include <assert.h>
+#include <stdio.h>
+#include <chrono>
+
+thread_local unsigned int JobSystem::t_WorkerIndex = 0;
+thread_local unsigned int JobSystem::t_JobDepth = 0;
+
+static long long GetNanoseconds()
+{
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+JobSystem::JobSystem(unsigned int numThreads)
+{
+	if (numThreads == 0)
+	{
+		unsigned int hardwareThreads = std::thread::hardware_concurrency();
+		numThreads = hardwareThreads > 1 ? hardwareThreads - 1 : 0;
+	}
+
+	for (unsigned int i = 0; i < numThreads + 1; i++)
+		m_Workers.push_back(new Worker());
+
+	m_StatsStartTime = GetNanoseconds();
+
+	for (unsigned int i = 1; i < numThreads + 1; i++)
+		m_Threads.emplace_back(&JobSystem::WorkerLoop, this, i);
+
+	printf("Job system: %u worker threads\n", numThreads);
+}
+
+JobSystem::~JobSystem()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_SleepMutex);
+		m_Quit = true;
+	}
+	m_WakeCondition.notify_all();
+
+	for (std::thread& thread : m_Threads)
+		thread.join();
+
+	for (Worker* worker : m_Workers)
+		delete worker;
+}
+
+void JobSystem::Schedule(std::function<void()> job, JobCounter* counter)
+{
+	if (counter)
+		counter->Value.fetch_add(1, std::memory_order_relaxed);
+
+	Worker* worker = m_Workers[t_WorkerIndex];
+	{
+		std::lock_guard<std::mutex> lock(worker->Mutex);
+		worker->Jobs.push_back({ std::move(job), counter });
+	}
+
+	// a sleeper either sees the new count before it blocks or is woken here
+	m_NumQueuedJobs.fetch_add(1);
+	if (m_NumSleeping.load() > 0)
+	{
+		{ std::lock_guard<std::mutex> lock(m_SleepMutex); }
+		m_WakeCondition.notify_one();
+	}
+}
+
+void JobSystem::Wait(const JobCounter& counter)
+{
+	unsigned int workerIndex = t_WorkerIndex;
+
+	while (!counter.IsDone())
+	{
+		if (!TryRunJob(workerIndex))
+			std::this_thread::yield();
+	}
+}
+
+void JobSystem::ParallelFor(unsigned int count, unsigned int batchSize, const ParallelForFunc& func)
+{
+	batchSize = batchSize > 0 ? batchSize : 1;
+
+	// a single batch isn't worth a round trip through the deques
+	if (count <= batchSize)
+	{
+		if (count > 0)
+			func(0, count, t_WorkerIndex);
+		return;
+	}
+
+	JobCounter counter;
+	for (unsigned int begin = 0; begin < count; begin += batchSize)
+	{
+		unsigned int end = begin + batchSize < count ? begin + batchSize : count;
+		Schedule([&func, begin, end] { func(begin, end, t_WorkerIndex); }, &counter);
+	}
+
+	Wait(counter);
+}
+
+void JobSystem::WorkerLoop(unsigned int workerIndex)
+{
+	t_WorkerIndex = workerIndex;
+
+	for (;;)
+	{
+		if (TryRunJob(workerIndex))
+			continue;
+
+		std::unique_lock<std::mutex> lock(m_SleepMutex);
+		m_NumSleeping.fetch_add(1);
+		m_WakeCondition.wait(lock, [this] { return m_Quit || m_NumQueuedJobs.load() > 0; });
+		m_NumSleeping.fetch_sub(1);
+
+		if (m_Quit)
+			return;
+	}
+}
+
+bool JobSystem::TryRunJob(unsigned int workerIndex)
+{
+	Job job;
+	if (!PopJob(workerIndex, job))
+		return false;
+
+	RunJob(workerIndex, job);
+	return true;
+}
+
+bool JobSystem::PopJob(unsigned int workerIndex, Job& job)
+{
+	if (m_NumQueuedJobs.load(std::memory_order_relaxed) == 0)
+		return false;
+
+	// newest own job first, its data is most likely still in cache
+	Worker* self = m_Workers[workerIndex];
+	{
+		std::lock_guard<std::mutex> lock(self->Mutex);
+		if (!self->Jobs.empty())
+		{
+			job = std::move(self->Jobs.back());
+			self->Jobs.pop_back();
+			m_NumQueuedJobs.fetch_sub(1);
+			return true;
+		}
+	}
+
+	// then the oldest job of the next worker that has one, which tends to be the biggest piece left
+	unsigned int numWorkers = (unsigned int)m_Workers.size();
+	for (unsigned int i = 1; i < numWorkers; i++)
+	{
+		Worker* victim = m_Workers[(workerIndex + i) % numWorkers];
+
+		std::lock_guard<std::mutex> lock(victim->Mutex);
+		if (!victim->Jobs.empty())
+		{
+			job = std::move(victim->Jobs.front());
+			victim->Jobs.pop_front();
+			m_NumQueuedJobs.fetch_sub(1);
+			self->NumSteals.fetch_add(1, std::memory_order_relaxed);
+			return true;
+		}
+	}
+
+	return false;
+}
+
+void JobSystem::RunJob(unsigned int workerIndex, Job& job)
+{
+	Worker* worker = m_Workers[workerIndex];
+
+	// jobs run while waiting inside another job are already counted as its busy time
+	bool outermost = t_JobDepth++ == 0;
+	long long startTime = outermost ? GetNanoseconds() : 0;
+
+	job.Func();
+
+	if (outermost)
+		worker->BusyNanoseconds.fetch_add(GetNanoseconds() - startTime, std::memory_order_relaxed);
+	worker->NumJobs.fetch_add(1, std::memory_order_relaxed);
+	t_JobDepth--;
+
+	if (job.Counter)
+		job.Counter->Value.fetch_sub(1, std::memory_order_release);
+}
+
+WorkerStats JobSystem::GetWorkerStats(unsigned int workerIndex) const
+{
+	const Worker* worker = m_Workers[workerIndex];
+
+	WorkerStats stats;
+	stats.BusySeconds = worker->BusyNanoseconds.load(std::memory_order_relaxed) * 1e-9;
+	stats.ElapsedSeconds = (GetNanoseconds() - m_StatsStartTime) * 1e-9;
+	stats.NumJobs = worker->NumJobs.load(std::memory_order_relaxed);
+	stats.NumSteals = worker->NumSteals.load(std::memory_order_relaxed);
+	return stats;
+}
+
+void JobSystem::ResetStats()
+{
+	for (Worker* worker : m_Workers)
+	{
+		worker->BusyNanoseconds.store(0, std::memory_order_relaxed);
+		worker->NumJobs.store(0, std::memory_order_relaxed);
+		worker->NumSteals.store(0, std::memory_order_relaxed);
+	}
+
+	m_StatsStartTime = GetNanoseconds();
+}
+
+void JobSystem::PrintStats() const
+{
+	for (unsigned int i = 0; i < m_Workers.size(); i++)
+	{
+		WorkerStats stats = GetWorkerStats(i);
+		printf("Worker %u: %5.1f%% busy, %u jobs, %u stolen\n", i, stats.GetUtilisation() * 100.0f, stats.NumJobs, stats.NumSteals);
+	}
+}
+
+void ParallelFor(JobSystem* jobSystem, unsigned int count, unsigned int batchSize, const ParallelForFunc& func)
+{
+	if (jobSystem)
+		jobSystem->ParallelFor(count, batchSize, func);
+	else if (count > 0)
+		func(0, count, 0);
+}
@@ -0,0 +1,103 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Number of unfinished jobs in a group. Jobs scheduled with a counter decrement it when they finish,
+// so a job that needs a group done first waits on its counter
+struct JobCounter
+{
+	std::atomic<unsigned int> Value{ 0 };
+
+	bool IsDone() const { return Value.load(std::memory_order_acquire) == 0; }
+};
+
+// Time a worker spent running jobs since the stats were last reset
+struct WorkerStats
+{
+	double BusySeconds = 0.0;
+	double ElapsedSeconds = 0.0;
+	unsigned int NumJobs = 0;
+	unsigned int NumSteals = 0;		// jobs taken from another worker's deque
+
+	float GetUtilisation() const { return ElapsedSeconds > 0.0 ? (float)(BusySeconds / ElapsedSeconds) : 0.0f; }
+};
+
+// [begin, end) of a ParallelFor and the worker running it, for indexing per worker scratch
+typedef std::function<void(unsigned int begin, unsigned int end, unsigned int workerIndex)> ParallelForFunc;
+
+// Work stealing scheduler. Worker 0 is the thread that created the system and only runs jobs while it waits,
+// the others are threads of their own. Each worker pushes and pops jobs at the back of its own deque, and
+// when it runs dry steals the oldest job from the front of another's, so work spreads without a shared queue.
+// Jobs may only be scheduled from the creating thread or from inside jobs
+class JobSystem
+{
+public:
+	// 0 threads starts one per hardware thread besides the calling one
+	JobSystem(unsigned int numThreads = 0);
+	~JobSystem();
+
+	void Schedule(std::function<void()> job, JobCounter* counter = nullptr);
+
+	// Runs jobs until the counter reaches 0, so waiting inside a job never blocks a worker
+	void Wait(const JobCounter& counter);
+
+	// Splits [0, count) into batches of batchSize jobs and returns once all of them ran
+	void ParallelFor(unsigned int count, unsigned int batchSize, const ParallelForFunc& func);
+
+	// Workers including the creating thread, per worker scratch arrays need this many entries
+	unsigned int GetNumWorkers() const { return (unsigned int)m_Workers.size(); }
+
+	// Index of the calling thread, 0 outside of any job system's threads
+	static unsigned int GetCurrentWorker() { return t_WorkerIndex; }
+
+	WorkerStats GetWorkerStats(unsigned int workerIndex) const;
+	void ResetStats();
+	void PrintStats() const;
+
+private:
+	struct Job
+	{
+		std::function<void()> Func;
+		JobCounter* Counter;
+	};
+
+	struct alignas(64) Worker
+	{
+		std::mutex Mutex;		// only contended while someone steals
+		std::deque<Job> Jobs;
+
+		std::atomic<long long> BusyNanoseconds{ 0 };
+		std::atomic<unsigned int> NumJobs{ 0 };
+		std::atomic<unsigned int> NumSteals{ 0 };
+	};
+
+	void WorkerLoop(unsigned int workerIndex);
+	bool TryRunJob(unsigned int workerIndex);
+	bool PopJob(unsigned int workerIndex, Job& job);
+	void RunJob(unsigned int workerIndex, Job& job);
+
+private:
+	std::vector<Worker*> m_Workers;
+	std::vector<std::thread> m_Threads;
+
+	// idle workers sleep until something is queued
+	std::atomic<unsigned int> m_NumQueuedJobs{ 0 };
+	std::atomic<unsigned int> m_NumSleeping{ 0 };
+	std::mutex m_SleepMutex;
+	std::condition_variable m_WakeCondition;
+	bool m_Quit = false;
+
+	long long m_StatsStartTime = 0;
+
+	static thread_local unsigned int t_WorkerIndex;
+	static thread_local unsigned int t_JobDepth;
+};
+
+// Runs func over [0, count) on jobSystem, or on the calling thread as worker 0 when it is nullptr
+void ParallelFor(JobSystem* jobSystem, unsigned int count, unsigned int batchSize, const ParallelForFunc& func);
@@ -0,0 +1,38 @@
+#pragma once
+
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+
+#include "AlignedAllocator.h"
+
+// Local space translation, rotation and scale of every skeleton node, stored as structure of arrays.
+// The arrays are padded to a multiple of 8 so SIMD kernels can run over them without a scalar tail
+struct LocalPose
+{
+	AlignedVector<float> PositionX, PositionY, PositionZ;
+	AlignedVector<float> RotationX, RotationY, RotationZ, RotationW;
+	AlignedVector<float> ScalingX, ScalingY, ScalingZ;
+
+	unsigned int NumNodes = 0;
+
+	void Resize(unsigned int numNodes)
+	{
+		NumNodes = numNodes;
+		unsigned int paddedSize = (numNodes + 7) & ~7u;
+
+		PositionX.resize(paddedSize, 0.0f); PositionY.resize(paddedSize, 0.0f); PositionZ.resize(paddedSize, 0.0f);
+		RotationX.resize(paddedSize, 0.0f); RotationY.resize(paddedSize, 0.0f); RotationZ.resize(paddedSize, 0.0f); RotationW.resize(paddedSize, 1.0f);
+		ScalingX.resize(paddedSize, 1.0f); ScalingY.resize(paddedSize, 1.0f); ScalingZ.resize(paddedSize, 1.0f);
+	}
+
+	void SetTransform(unsigned int i, const glm::vec3& position, const glm::quat& rotation, const glm::vec3& scaling)
+	{
+		PositionX[i] = position.x; PositionY[i] = position.y; PositionZ[i] = position.z;
+		RotationX[i] = rotation.x; RotationY[i] = rotation.y; RotationZ[i] = rotation.z; RotationW[i] = rotation.w;
+		ScalingX[i] = scaling.x; ScalingY[i] = scaling.y; ScalingZ[i] = scaling.z;
+	}
+
+	glm::vec3 GetPosition(unsigned int i) const { return glm::vec3(PositionX[i], PositionY[i], PositionZ[i]); }
+	glm::quat GetRotation(unsigned int i) const { return glm::quat(RotationW[i], RotationX[i], RotationY[i], RotationZ[i]); }
+	glm::vec3 GetScaling(unsigned int i) const { return glm::vec3(ScalingX[i], ScalingY[i], ScalingZ[i]); }
+};
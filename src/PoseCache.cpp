@@ -0,0 +1,62 @@
+#include "PoseCache.h"
+
+#include <iterator>
+
+PoseCache::PoseCache(float bucketsPerSecond, size_t maxBytes)
+	: m_BucketsPerSecond(bucketsPerSecond), m_MaxBytes(maxBytes)
+{
+}
+
+const std::vector<glm::mat4>* PoseCache::Find(const AnimationClip* clip, unsigned int bucket, unsigned int lod)
+{
+	auto it = m_Lookup.find({ clip, bucket, lod });
+
+	if (it == m_Lookup.end())
+	{
+		m_Misses++;
+		return nullptr;
+	}
+
+	m_Hits++;
+	m_Entries.splice(m_Entries.begin(), m_Entries, it->second);
+	return &it->second->Palette;
+}
+
+void PoseCache::Insert(const AnimationClip* clip, unsigned int bucket, unsigned int lod, const std::vector<glm::mat4>& palette)
+{
+	Key key = { clip, bucket, lod };
+	size_t paletteBytes = palette.size() * sizeof(glm::mat4);
+
+	if (paletteBytes > m_MaxBytes || m_Lookup.find(key) != m_Lookup.end())
+		return;
+
+	// evict from the back, keeping the last evicted entry's storage for the new palette
+	std::list<Entry> recycled;
+	while (!m_Entries.empty() && m_MemoryUsage + paletteBytes > m_MaxBytes)
+	{
+		Entry& oldest = m_Entries.back();
+		m_MemoryUsage -= oldest.Palette.size() * sizeof(glm::mat4);
+		m_Lookup.erase(oldest.EntryKey);
+
+		recycled.clear();
+		recycled.splice(recycled.begin(), m_Entries, std::prev(m_Entries.end()));
+	}
+
+	if (recycled.empty())
+		recycled.emplace_back();
+
+	Entry& entry = recycled.front();
+	entry.EntryKey = key;
+	entry.Palette = palette;
+
+	m_Entries.splice(m_Entries.begin(), recycled);
+	m_Lookup[key] = m_Entries.begin();
+	m_MemoryUsage += paletteBytes;
+}
+
+void PoseCache::Clear()
+{
+	m_Entries.clear();
+	m_Lookup.clear();
+	m_MemoryUsage = 0;
+}
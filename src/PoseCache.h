@@ -0,0 +1,66 @@
+#pragma once
+
+#include <glm/glm.hpp>
+#include <list>
+#include <unordered_map>
+#include <vector>
+
+class AnimationClip;
+
+// Finished bone palettes keyed by clip and quantized clip time, shared by every instance playing a clip
+// on its own (no fade, blend space or layer). Instances landing in the same time bucket reuse one palette.
+// The least recently used palettes are evicted to stay under the memory cap
+class PoseCache
+{
+public:
+	PoseCache(float bucketsPerSecond = 120.0f, size_t maxBytes = 16 * 1024 * 1024);
+
+	unsigned int GetBucket(double clipTimeInSeconds) const { return (unsigned int)(clipTimeInSeconds * m_BucketsPerSecond); }
+	double GetBucketTime(unsigned int bucket) const { return bucket / (double)m_BucketsPerSecond; }
+
+	// nullptr on a miss. A hit becomes the most recently used palette
+	const std::vector<glm::mat4>* Find(const AnimationClip* clip, unsigned int bucket, unsigned int lod);
+
+	// Stores a palette computed after a miss, evicting old ones as needed
+	void Insert(const AnimationClip* clip, unsigned int bucket, unsigned int lod, const std::vector<glm::mat4>& palette);
+
+	void Clear();
+	void ResetCounters() { m_Hits = 0; m_Misses = 0; }
+
+	size_t GetHits() const { return m_Hits; }
+	size_t GetMisses() const { return m_Misses; }
+	size_t GetNumPalettes() const { return m_Entries.size(); }
+	size_t GetMemoryUsage() const { return m_MemoryUsage; }
+
+private:
+	struct Key
+	{
+		const AnimationClip* Clip;
+		unsigned int Bucket;
+		unsigned int LOD;		// skeleton LOD the palette was evaluated at
+
+		bool operator==(const Key& other) const { return Clip == other.Clip && Bucket == other.Bucket && LOD == other.LOD; }
+	};
+
+	struct KeyHash
+	{
+		size_t operator()(const Key& key) const { return std::hash<const void*>()(key.Clip) ^ ((key.Bucket * 4 + key.LOD) * 0x9E3779B9u); }
+	};
+
+	struct Entry
+	{
+		Key EntryKey;
+		std::vector<glm::mat4> Palette;
+	};
+
+private:
+	float m_BucketsPerSecond;
+	size_t m_MaxBytes;
+	size_t m_MemoryUsage = 0;
+
+	std::list<Entry> m_Entries;		// most recently used first
+	std::unordered_map<Key, std::list<Entry>::iterator, KeyHash> m_Lookup;
+
+	size_t m_Hits = 0;
+	size_t m_Misses = 0;
+};
@@ -0,0 +1,319 @@
+#pragma once
+
+// Interpolation kernels shared by the scalar, SSE and AVX2 samplers.
+// Each Lane type wraps the handful of operations the kernels need for one ISA, so every
+// kernel runs the same math and the results only differ by rounding.
+// This header is included by the AVX2 translation unit, so it must stay free of glm/std inline code.
+
+#include <immintrin.h>
+#include <math.h>
+
+struct Vec3Stream
+{
+	float* X;
+	float* Y;
+	float* Z;
+};
+
+struct QuatStream
+{
+	float* X;
+	float* Y;
+	float* Z;
+	float* W;
+};
+
+// count must be a multiple of Lane::Width
+template <typename Lane>
+inline void LerpVec3Kernel(const Vec3Stream& start, const Vec3Stream& end, const float* factors, const Vec3Stream& out, unsigned int count)
+{
+	typedef typename Lane::Type V;
+
+	for (unsigned int i = 0; i < count; i += Lane::Width)
+	{
+		V t = Lane::Load(factors + i);
+
+		V x0 = Lane::Load(start.X + i), y0 = Lane::Load(start.Y + i), z0 = Lane::Load(start.Z + i);
+		V x1 = Lane::Load(end.X + i), y1 = Lane::Load(end.Y + i), z1 = Lane::Load(end.Z + i);
+
+		Lane::Store(out.X + i, Lane::Add(x0, Lane::Mul(Lane::Sub(x1, x0), t)));
+		Lane::Store(out.Y + i, Lane::Add(y0, Lane::Mul(Lane::Sub(y1, y0), t)));
+		Lane::Store(out.Z + i, Lane::Add(z0, Lane::Mul(Lane::Sub(z1, z0), t)));
+	}
+}
+
+// acos(x) for x in [0, 1], Abramowitz and Stegun 4.4.46, |error| <= 2e-8
+template <typename Lane>
+inline typename Lane::Type AcosPositive(typename Lane::Type x)
+{
+	typedef typename Lane::Type V;
+
+	V p = Lane::Set1(-0.0012624911f);
+	p = Lane::Add(Lane::Mul(p, x), Lane::Set1(0.0066700901f));
+	p = Lane::Add(Lane::Mul(p, x), Lane::Set1(-0.0170881256f));
+	p = Lane::Add(Lane::Mul(p, x), Lane::Set1(0.0308918810f));
+	p = Lane::Add(Lane::Mul(p, x), Lane::Set1(-0.0501743046f));
+	p = Lane::Add(Lane::Mul(p, x), Lane::Set1(0.0889789874f));
+	p = Lane::Add(Lane::Mul(p, x), Lane::Set1(-0.2145988016f));
+	p = Lane::Add(Lane::Mul(p, x), Lane::Set1(1.5707963050f));
+
+	return Lane::Mul(p, Lane::Sqrt(Lane::Sub(Lane::Set1(1.0f), x)));
+}
+
+// sin(x) for x in [0, pi/2], Taylor series up to x^11
+template <typename Lane>
+inline typename Lane::Type SinHalfPi(typename Lane::Type x)
+{
+	typedef typename Lane::Type V;
+
+	V x2 = Lane::Mul(x, x);
+	V p = Lane::Set1(-2.5052108e-8f);
+	p = Lane::Add(Lane::Mul(p, x2), Lane::Set1(2.7557319e-6f));
+	p = Lane::Add(Lane::Mul(p, x2), Lane::Set1(-1.9841270e-4f));
+	p = Lane::Add(Lane::Mul(p, x2), Lane::Set1(8.3333333e-3f));
+	p = Lane::Add(Lane::Mul(p, x2), Lane::Set1(-1.6666667e-1f));
+	p = Lane::Add(Lane::Mul(p, x2), Lane::Set1(1.0f));
+
+	return Lane::Mul(p, x);
+}
+
+// Shortest path slerp followed by normalization. Falls back to lerp where the keys are nearly identical
+template <typename Lane>
+inline void SlerpQuatKernel(const QuatStream& start, const QuatStream& end, const float* factors, const QuatStream& out, unsigned int count)
+{
+	typedef typename Lane::Type V;
+
+	const V one = Lane::Set1(1.0f);
+	const V lerpThreshold = Lane::Set1(1.0f - 1e-5f);
+
+	for (unsigned int i = 0; i < count; i += Lane::Width)
+	{
+		V t = Lane::Load(factors + i);
+
+		V x0 = Lane::Load(start.X + i), y0 = Lane::Load(start.Y + i), z0 = Lane::Load(start.Z + i), w0 = Lane::Load(start.W + i);
+		V x1 = Lane::Load(end.X + i), y1 = Lane::Load(end.Y + i), z1 = Lane::Load(end.Z + i), w1 = Lane::Load(end.W + i);
+
+		V cosTheta = Lane::Add(Lane::Add(Lane::Mul(x0, x1), Lane::Mul(y0, y1)), Lane::Add(Lane::Mul(z0, z1), Lane::Mul(w0, w1)));
+
+		// take the short way around by flipping the end key into the start key's hemisphere
+		x1 = Lane::MulSign(x1, cosTheta); y1 = Lane::MulSign(y1, cosTheta);
+		z1 = Lane::MulSign(z1, cosTheta); w1 = Lane::MulSign(w1, cosTheta);
+		cosTheta = Lane::Min(Lane::Abs(cosTheta), one);
+
+		V theta = AcosPositive<Lane>(cosTheta);
+		V invSinTheta = Lane::Div(one, Lane::Sqrt(Lane::Sub(one, Lane::Mul(cosTheta, cosTheta))));
+		V weight0 = Lane::Mul(SinHalfPi<Lane>(Lane::Mul(Lane::Sub(one, t), theta)), invSinTheta);
+		V weight1 = Lane::Mul(SinHalfPi<Lane>(Lane::Mul(t, theta)), invSinTheta);
+
+		V useLerp = Lane::CmpGt(cosTheta, lerpThreshold);
+		weight0 = Lane::Select(useLerp, Lane::Sub(one, t), weight0);
+		weight1 = Lane::Select(useLerp, t, weight1);
+
+		V x = Lane::Add(Lane::Mul(x0, weight0), Lane::Mul(x1, weight1));
+		V y = Lane::Add(Lane::Mul(y0, weight0), Lane::Mul(y1, weight1));
+		V z = Lane::Add(Lane::Mul(z0, weight0), Lane::Mul(z1, weight1));
+		V w = Lane::Add(Lane::Mul(w0, weight0), Lane::Mul(w1, weight1));
+
+		V invLength = Lane::Div(one, Lane::Sqrt(Lane::Add(Lane::Add(Lane::Mul(x, x), Lane::Mul(y, y)), Lane::Add(Lane::Mul(z, z), Lane::Mul(w, w)))));
+
+		Lane::Store(out.X + i, Lane::Mul(x, invLength));
+		Lane::Store(out.Y + i, Lane::Mul(y, invLength));
+		Lane::Store(out.Z + i, Lane::Mul(z, invLength));
+		Lane::Store(out.W + i, Lane::Mul(w, invLength));
+	}
+}
+
+template <typename Lane>
+inline void NlerpQuatLanes(const QuatStream& start, const QuatStream& end, typename Lane::Type t, const QuatStream& out, unsigned int i)
+{
+	typedef typename Lane::Type V;
+
+	V x0 = Lane::Load(start.X + i), y0 = Lane::Load(start.Y + i), z0 = Lane::Load(start.Z + i), w0 = Lane::Load(start.W + i);
+	V x1 = Lane::Load(end.X + i), y1 = Lane::Load(end.Y + i), z1 = Lane::Load(end.Z + i), w1 = Lane::Load(end.W + i);
+
+	V x = Lane::Add(x0, Lane::Mul(Lane::Sub(x1, x0), t));
+	V y = Lane::Add(y0, Lane::Mul(Lane::Sub(y1, y0), t));
+	V z = Lane::Add(z0, Lane::Mul(Lane::Sub(z1, z0), t));
+	V w = Lane::Add(w0, Lane::Mul(Lane::Sub(w1, w0), t));
+
+	V invLength = Lane::Div(Lane::Set1(1.0f), Lane::Sqrt(Lane::Add(Lane::Add(Lane::Mul(x, x), Lane::Mul(y, y)), Lane::Add(Lane::Mul(z, z), Lane::Mul(w, w)))));
+
+	Lane::Store(out.X + i, Lane::Mul(x, invLength));
+	Lane::Store(out.Y + i, Lane::Mul(y, invLength));
+	Lane::Store(out.Z + i, Lane::Mul(z, invLength));
+	Lane::Store(out.W + i, Lane::Mul(w, invLength));
+}
+
+// Normalized lerp. The keys must already be on the same hemisphere, AnimationClip aligns them at import
+template <typename Lane>
+inline void NlerpQuatKernel(const QuatStream& start, const QuatStream& end, const float* factors, const QuatStream& out, unsigned int count)
+{
+	for (unsigned int i = 0; i < count; i += Lane::Width)
+		NlerpQuatLanes<Lane>(start, end, Lane::Load(factors + i), out, i);
+}
+
+// Nlerp with the factor bent by a fitted polynomial so the angular velocity matches slerp,
+// see "Approximating slerp" by Arseny Kapoulkine. Keys must be hemisphere aligned like for nlerp
+template <typename Lane>
+inline void ApproxSlerpQuatKernel(const QuatStream& start, const QuatStream& end, const float* factors, const QuatStream& out, unsigned int count)
+{
+	typedef typename Lane::Type V;
+
+	const V half = Lane::Set1(0.5f);
+	const V one = Lane::Set1(1.0f);
+
+	for (unsigned int i = 0; i < count; i += Lane::Width)
+	{
+		V t = Lane::Load(factors + i);
+
+		V cosTheta = Lane::Add(
+			Lane::Add(Lane::Mul(Lane::Load(start.X + i), Lane::Load(end.X + i)), Lane::Mul(Lane::Load(start.Y + i), Lane::Load(end.Y + i))),
+			Lane::Add(Lane::Mul(Lane::Load(start.Z + i), Lane::Load(end.Z + i)), Lane::Mul(Lane::Load(start.W + i), Lane::Load(end.W + i))));
+		V d = Lane::Abs(cosTheta);
+
+		V a = Lane::Add(Lane::Set1(3.55645f), Lane::Mul(d, Lane::Set1(-1.43519f)));
+		a = Lane::Add(Lane::Set1(-3.2452f), Lane::Mul(d, a));
+		a = Lane::Add(Lane::Set1(1.0904f), Lane::Mul(d, a));
+		V b = Lane::Add(Lane::Set1(-1.06021f), Lane::Mul(d, Lane::Set1(0.215638f)));
+		b = Lane::Add(Lane::Set1(0.848013f), Lane::Mul(d, b));
+
+		V tCentered = Lane::Sub(t, half);
+		V k = Lane::Add(Lane::Mul(a, Lane::Mul(tCentered, tCentered)), b);
+		V correctedT = Lane::Add(t, Lane::Mul(Lane::Mul(t, tCentered), Lane::Mul(Lane::Sub(t, one), k)));
+
+		NlerpQuatLanes<Lane>(start, end, correctedT, out, i);
+	}
+}
+
+struct PoseStream
+{
+	Vec3Stream Positions;
+	QuatStream Rotations;
+	Vec3Stream Scalings;
+};
+
+// Shortest path nlerp between two arbitrary rotations, used to blend poses rather than keys
+template <typename Lane>
+inline void BlendQuatKernel(const QuatStream& start, const QuatStream& end, const float* weights, const QuatStream& out, unsigned int count)
+{
+	typedef typename Lane::Type V;
+
+	for (unsigned int i = 0; i < count; i += Lane::Width)
+	{
+		V t = Lane::Load(weights + i);
+
+		V x0 = Lane::Load(start.X + i), y0 = Lane::Load(start.Y + i), z0 = Lane::Load(start.Z + i), w0 = Lane::Load(start.W + i);
+		V x1 = Lane::Load(end.X + i), y1 = Lane::Load(end.Y + i), z1 = Lane::Load(end.Z + i), w1 = Lane::Load(end.W + i);
+
+		V cosTheta = Lane::Add(Lane::Add(Lane::Mul(x0, x1), Lane::Mul(y0, y1)), Lane::Add(Lane::Mul(z0, z1), Lane::Mul(w0, w1)));
+		x1 = Lane::MulSign(x1, cosTheta); y1 = Lane::MulSign(y1, cosTheta);
+		z1 = Lane::MulSign(z1, cosTheta); w1 = Lane::MulSign(w1, cosTheta);
+
+		V x = Lane::Add(x0, Lane::Mul(Lane::Sub(x1, x0), t));
+		V y = Lane::Add(y0, Lane::Mul(Lane::Sub(y1, y0), t));
+		V z = Lane::Add(z0, Lane::Mul(Lane::Sub(z1, z0), t));
+		V w = Lane::Add(w0, Lane::Mul(Lane::Sub(w1, w0), t));
+
+		V invLength = Lane::Div(Lane::Set1(1.0f), Lane::Sqrt(Lane::Add(Lane::Add(Lane::Mul(x, x), Lane::Mul(y, y)), Lane::Add(Lane::Mul(z, z), Lane::Mul(w, w)))));
+
+		Lane::Store(out.X + i, Lane::Mul(x, invLength));
+		Lane::Store(out.Y + i, Lane::Mul(y, invLength));
+		Lane::Store(out.Z + i, Lane::Mul(z, invLength));
+		Lane::Store(out.W + i, Lane::Mul(w, invLength));
+	}
+}
+
+// out = mix(a, b, weights[node]) for every node
+template <typename Lane>
+inline void BlendPoseKernel(const PoseStream& a, const PoseStream& b, const float* weights, const PoseStream& out, unsigned int count)
+{
+	LerpVec3Kernel<Lane>(a.Positions, b.Positions, weights, out.Positions, count);
+	BlendQuatKernel<Lane>(a.Rotations, b.Rotations, weights, out.Rotations, count);
+	LerpVec3Kernel<Lane>(a.Scalings, b.Scalings, weights, out.Scalings, count);
+}
+
+// out = base * nlerp(identity, delta, weights[node]) for rotations, base + delta * weight for positions
+// and base * mix(1, delta, weight) for scales. out may alias base
+template <typename Lane>
+inline void AddPoseKernel(const PoseStream& base, const PoseStream& delta, const float* weights, const PoseStream& out, unsigned int count)
+{
+	typedef typename Lane::Type V;
+
+	const V one = Lane::Set1(1.0f);
+
+	for (unsigned int i = 0; i < count; i += Lane::Width)
+	{
+		V t = Lane::Load(weights + i);
+
+		Lane::Store(out.Positions.X + i, Lane::Add(Lane::Load(base.Positions.X + i), Lane::Mul(Lane::Load(delta.Positions.X + i), t)));
+		Lane::Store(out.Positions.Y + i, Lane::Add(Lane::Load(base.Positions.Y + i), Lane::Mul(Lane::Load(delta.Positions.Y + i), t)));
+		Lane::Store(out.Positions.Z + i, Lane::Add(Lane::Load(base.Positions.Z + i), Lane::Mul(Lane::Load(delta.Positions.Z + i), t)));
+
+		Lane::Store(out.Scalings.X + i, Lane::Mul(Lane::Load(base.Scalings.X + i), Lane::Add(one, Lane::Mul(Lane::Sub(Lane::Load(delta.Scalings.X + i), one), t))));
+		Lane::Store(out.Scalings.Y + i, Lane::Mul(Lane::Load(base.Scalings.Y + i), Lane::Add(one, Lane::Mul(Lane::Sub(Lane::Load(delta.Scalings.Y + i), one), t))));
+		Lane::Store(out.Scalings.Z + i, Lane::Mul(Lane::Load(base.Scalings.Z + i), Lane::Add(one, Lane::Mul(Lane::Sub(Lane::Load(delta.Scalings.Z + i), one), t))));
+
+		// weight the delta by nlerp from identity, with the delta flipped next to identity first
+		V dw = Lane::Load(delta.Rotations.W + i);
+		V dx = Lane::MulSign(Lane::Mul(Lane::Load(delta.Rotations.X + i), t), dw);
+		V dy = Lane::MulSign(Lane::Mul(Lane::Load(delta.Rotations.Y + i), t), dw);
+		V dz = Lane::MulSign(Lane::Mul(Lane::Load(delta.Rotations.Z + i), t), dw);
+		dw = Lane::Add(Lane::Sub(one, t), Lane::Mul(Lane::Abs(dw), t));
+
+		V bx = Lane::Load(base.Rotations.X + i), by = Lane::Load(base.Rotations.Y + i);
+		V bz = Lane::Load(base.Rotations.Z + i), bw = Lane::Load(base.Rotations.W + i);
+
+		// Hamilton product base * delta
+		V x = Lane::Add(Lane::Add(Lane::Mul(bw, dx), Lane::Mul(bx, dw)), Lane::Sub(Lane::Mul(by, dz), Lane::Mul(bz, dy)));
+		V y = Lane::Add(Lane::Sub(Lane::Mul(bw, dy), Lane::Mul(bx, dz)), Lane::Add(Lane::Mul(by, dw), Lane::Mul(bz, dx)));
+		V z = Lane::Add(Lane::Add(Lane::Mul(bw, dz), Lane::Mul(bx, dy)), Lane::Sub(Lane::Mul(bz, dw), Lane::Mul(by, dx)));
+		V w = Lane::Sub(Lane::Sub(Lane::Mul(bw, dw), Lane::Mul(bx, dx)), Lane::Add(Lane::Mul(by, dy), Lane::Mul(bz, dz)));
+
+		V invLength = Lane::Div(one, Lane::Sqrt(Lane::Add(Lane::Add(Lane::Mul(x, x), Lane::Mul(y, y)), Lane::Add(Lane::Mul(z, z), Lane::Mul(w, w)))));
+
+		Lane::Store(out.Rotations.X + i, Lane::Mul(x, invLength));
+		Lane::Store(out.Rotations.Y + i, Lane::Mul(y, invLength));
+		Lane::Store(out.Rotations.Z + i, Lane::Mul(z, invLength));
+		Lane::Store(out.Rotations.W + i, Lane::Mul(w, invLength));
+	}
+}
+
+struct ScalarLane
+{
+	typedef float Type;
+	static const unsigned int Width = 1;
+
+	static float Load(const float* p) { return *p; }
+	static void Store(float* p, float v) { *p = v; }
+	static float Set1(float v) { return v; }
+	static float Add(float a, float b) { return a + b; }
+	static float Sub(float a, float b) { return a - b; }
+	static float Mul(float a, float b) { return a * b; }
+	static float Div(float a, float b) { return a / b; }
+	static float Min(float a, float b) { return a < b ? a : b; }
+	static float Abs(float a) { return a < 0.0f ? -a : a; }
+	static float Sqrt(float a) { return sqrtf(a); }
+	static float MulSign(float a, float sign) { return sign < 0.0f ? -a : a; }
+	static float CmpGt(float a, float b) { return a > b ? 1.0f : 0.0f; }
+	static float Select(float mask, float a, float b) { return mask != 0.0f ? a : b; }
+};
+
+struct SSELane
+{
+	typedef __m128 Type;
+	static const unsigned int Width = 4;
+
+	static __m128 Load(const float* p) { return _mm_load_ps(p); }
+	static void Store(float* p, __m128 v) { _mm_store_ps(p, v); }
+	static __m128 Set1(float v) { return _mm_set1_ps(v); }
+	static __m128 Add(__m128 a, __m128 b) { return _mm_add_ps(a, b); }
+	static __m128 Sub(__m128 a, __m128 b) { return _mm_sub_ps(a, b); }
+	static __m128 Mul(__m128 a, __m128 b) { return _mm_mul_ps(a, b); }
+	static __m128 Div(__m128 a, __m128 b) { return _mm_div_ps(a, b); }
+	static __m128 Min(__m128 a, __m128 b) { return _mm_min_ps(a, b); }
+	static __m128 Abs(__m128 a) { return _mm_andnot_ps(_mm_set1_ps(-0.0f), a); }
+	static __m128 Sqrt(__m128 a) { return _mm_sqrt_ps(a); }
+	static __m128 MulSign(__m128 a, __m128 sign) { return _mm_xor_ps(a, _mm_and_ps(sign, _mm_set1_ps(-0.0f))); }
+	static __m128 CmpGt(__m128 a, __m128 b) { return _mm_cmpgt_ps(a, b); }
+	static __m128 Select(__m128 mask, __m128 a, __m128 b) { return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b)); }
+};
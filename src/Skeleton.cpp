@@ -0,0 +1,209 @@
+#include "Skeleton.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include "AssimpGLM.h"
+
+void DecomposeTransform(const glm::mat4& m, glm::vec3& position, glm::quat& rotation, glm::vec3& scaling)
+{
+	position = glm::vec3(m[3]);
+
+	scaling = glm::vec3(glm::length(glm::vec3(m[0])), glm::length(glm::vec3(m[1])), glm::length(glm::vec3(m[2])));
+	if (glm::determinant(glm::mat3(m)) < 0.0f)
+		scaling.x = -scaling.x;
+
+	glm::mat3 rotationMat(
+		scaling.x != 0.0f ? glm::vec3(m[0]) / scaling.x : glm::vec3(1, 0, 0),
+		scaling.y != 0.0f ? glm::vec3(m[1]) / scaling.y : glm::vec3(0, 1, 0),
+		scaling.z != 0.0f ? glm::vec3(m[2]) / scaling.z : glm::vec3(0, 0, 1));
+	rotation = glm::normalize(glm::quat_cast(rotationMat));
+}
+
+void Skeleton::Build(const aiNode* rootNode, const std::map<std::string, unsigned int>& boneNameToIndexMap)
+{
+	m_ParentIndices.clear();
+	m_BoneIndices.clear();
+	m_NodeNames.clear();
+	m_FoldedChains.clear();
+	m_NumFoldedHelpers = 0;
+
+	std::vector<glm::mat4> bindLocals;
+	AddNode(rootNode, -1, boneNameToIndexMap, bindLocals, std::vector<FoldedNode>());
+
+	if (m_NumFoldedHelpers > 0)
+		printf("Collapsed %u FBX helper nodes, %u nodes left\n", m_NumFoldedHelpers, GetNumNodes());
+
+	// every node is evaluated until BuildLODs and SetAnimatedNodes say otherwise
+	m_StaticNodes.assign(GetNumNodes(), false);
+
+	std::vector<float> noInfluences(GetNumNodes(), 0.0f);
+	const float noThresholds[MAX_SKELETON_LODS] = { 0.0f };
+	BuildLODs(noInfluences, noThresholds);
+
+	m_BindPose = LocalPose();
+	m_BindPose.Resize(GetNumNodes());
+
+	for (unsigned int i = 0; i < GetNumNodes(); i++)
+	{
+		glm::vec3 position, scaling;
+		glm::quat rotation;
+		DecomposeTransform(bindLocals[i], position, rotation, scaling);
+		m_BindPose.SetTransform(i, position, rotation, scaling);
+	}
+}
+
+// Assimp's FBX importer splits pivots and transform components into "<node>_$AssimpFbx$_<part>" parents
+static bool IsFbxHelperNode(const aiNode* node)
+{
+	return node->mNumChildren == 1 && strstr(node->mName.C_Str(), "_$AssimpFbx$_") != nullptr;
+}
+
+void Skeleton::AddNode(const aiNode* node, int parentIndex, const std::map<std::string, unsigned int>& boneNameToIndexMap, std::vector<glm::mat4>& bindLocals,
+	std::vector<FoldedNode> helpers)
+{
+	std::string nodeName = node->mName.C_Str();
+	glm::mat4 bindLocal = AiMatToGLM(node->mTransformation);
+
+	// helpers are folded into the node at the end of their chain
+	if (IsFbxHelperNode(node))
+	{
+		helpers.push_back({ nodeName, bindLocal });
+		m_NumFoldedHelpers++;
+		AddNode(node->mChildren[0], parentIndex, boneNameToIndexMap, bindLocals, helpers);
+		return;
+	}
+
+	if (!helpers.empty())
+	{
+		helpers.push_back({ nodeName, bindLocal });
+
+		bindLocal = glm::mat4(1.0f);
+		for (const FoldedNode& folded : helpers)
+			bindLocal = bindLocal * folded.BindLocal;
+	}
+
+	int nodeIndex = (int)m_ParentIndices.size();
+	auto it = boneNameToIndexMap.find(nodeName);
+
+	m_ParentIndices.push_back(parentIndex);
+	bindLocals.push_back(bindLocal);
+	m_BoneIndices.push_back(it != boneNameToIndexMap.end() ? (int)it->second : -1);
+	m_NodeNames.push_back(nodeName);
+	m_FoldedChains.push_back(helpers);
+
+	for (unsigned int i = 0; i < node->mNumChildren; i++)
+		AddNode(node->mChildren[i], nodeIndex, boneNameToIndexMap, bindLocals, std::vector<FoldedNode>());
+}
+
+int Skeleton::FindNode(const std::string& nodeName) const
+{
+	for (unsigned int i = 0; i < m_NodeNames.size(); i++)
+	{
+		if (m_NodeNames[i] == nodeName)
+			return (int)i;
+	}
+
+	return -1;
+}
+
+unsigned int Skeleton::GetSubtreeEnd(unsigned int nodeIndex) const
+{
+	// the first node after the subtree is parented above nodeIndex
+	unsigned int end = nodeIndex + 1;
+	while (end < GetNumNodes() && m_ParentIndices[end] >= (int)nodeIndex)
+		end++;
+
+	return end;
+}
+
+void Skeleton::BuildLODs(const std::vector<float>& nodeInfluences, const float* lodThresholds)
+{
+	unsigned int numNodes = GetNumNodes();
+
+	// children come after their parents, so a reverse walk sums every subtree
+	std::vector<float> subtreeInfluences(nodeInfluences);
+	for (unsigned int i = numNodes; i-- > 1;)
+		subtreeInfluences[m_ParentIndices[i]] += subtreeInfluences[i];
+
+	float totalInfluence = numNodes > 0 ? subtreeInfluences[0] : 0.0f;
+
+	m_NodeLODs.assign(numNodes, 0);
+	for (unsigned int i = 0; i < numNodes; i++)
+	{
+		for (unsigned int lod = 1; lod < MAX_SKELETON_LODS && subtreeInfluences[i] >= lodThresholds[lod] * totalInfluence; lod++)
+			m_NodeLODs[i] = (unsigned char)lod;
+	}
+
+	for (unsigned int lod = 1; lod < MAX_SKELETON_LODS; lod++)
+	{
+		// a skipped bone follows its nearest evaluated ancestor bone, keep the ones that have none
+		for (unsigned int i = 0; i < numNodes; i++)
+		{
+			if (m_NodeLODs[i] >= lod || m_BoneIndices[i] < 0)
+				continue;
+
+			int source = m_ParentIndices[i];
+			while (source >= 0 && (m_NodeLODs[source] < lod || m_BoneIndices[source] < 0))
+				source = m_ParentIndices[source];
+
+			if (source < 0)
+			{
+				for (int node = (int)i; node >= 0 && m_NodeLODs[node] < lod; node = m_ParentIndices[node])
+					m_NodeLODs[node] = (unsigned char)lod;
+			}
+		}
+	}
+
+	BuildLODLists();
+}
+
+void Skeleton::SetAnimatedNodes(const std::vector<bool>& nodeHasChannel)
+{
+	// a node is static when neither it nor any ancestor is ever animated
+	for (unsigned int i = 0; i < GetNumNodes(); i++)
+	{
+		bool parentStatic = m_ParentIndices[i] < 0 || m_StaticNodes[m_ParentIndices[i]];
+		m_StaticNodes[i] = parentStatic && !nodeHasChannel[i];
+	}
+
+	BuildLODLists();
+}
+
+unsigned int Skeleton::GetNumStaticNodes() const
+{
+	return (unsigned int)std::count(m_StaticNodes.begin(), m_StaticNodes.end(), true);
+}
+
+void Skeleton::BuildLODLists()
+{
+	unsigned int numNodes = GetNumNodes();
+
+	for (unsigned int lod = 0; lod < MAX_SKELETON_LODS; lod++)
+	{
+		m_LODNodes[lod].clear();
+		m_LODBoneProxies[lod].clear();
+
+		for (unsigned int i = 0; i < numNodes; i++)
+		{
+			// static nodes are evaluated once at load and keep their exact transform at every LOD
+			if (m_StaticNodes[i])
+				continue;
+
+			if (m_NodeLODs[i] >= lod)
+			{
+				m_LODNodes[lod].push_back(i);
+				continue;
+			}
+
+			if (m_BoneIndices[i] < 0)
+				continue;
+
+			int source = m_ParentIndices[i];
+			while (m_NodeLODs[source] < lod || m_BoneIndices[source] < 0)
+				source = m_ParentIndices[source];
+
+			m_LODBoneProxies[lod].push_back({ (unsigned int)m_BoneIndices[i], (unsigned int)m_BoneIndices[source] });
+		}
+	}
+}
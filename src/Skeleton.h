@@ -0,0 +1,90 @@
+#pragma once
+
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+#include <string>
+#include <vector>
+#include <map>
+#include <assimp/scene.h>
+
+#include "Pose.h"
+
+#define MAX_SKELETON_LODS 4
+
+// Bone left out at a skeleton LOD, it takes the palette entry of its nearest evaluated ancestor bone
+struct BoneProxy
+{
+	unsigned int Bone;
+	unsigned int SourceBone;
+};
+
+// One node of a collapsed FBX helper chain, parent-most first and ending with the node that keeps the name
+struct FoldedNode
+{
+	std::string Name;
+	glm::mat4 BindLocal;
+};
+
+// Splits an affine node transform into translation, rotation and scale. Shear is dropped
+void DecomposeTransform(const glm::mat4& m, glm::vec3& position, glm::quat& rotation, glm::vec3& scaling);
+
+// Flattened copy of the aiNode hierarchy, built once at load.
+// Nodes are stored in depth-first order so a parent always precedes its children.
+// Assimp FBX helper nodes are folded into the node below them, so only real joints remain.
+class Skeleton
+{
+public:
+	Skeleton() {};
+
+	void Build(const aiNode* rootNode, const std::map<std::string, unsigned int>& boneNameToIndexMap);
+
+	unsigned int GetNumNodes() const { return (unsigned int)m_ParentIndices.size(); }
+
+	const std::vector<int>& GetParentIndices() const { return m_ParentIndices; }
+	const LocalPose& GetBindPose() const { return m_BindPose; }
+	const std::vector<int>& GetBoneIndices() const { return m_BoneIndices; }
+	const std::vector<std::string>& GetNodeNames() const { return m_NodeNames; }
+
+	// Original nodes a node was collapsed from, empty when it had no helpers. Clips use it to fold helper channels
+	const std::vector<FoldedNode>& GetFoldedChain(unsigned int nodeIndex) const { return m_FoldedChains[nodeIndex]; }
+
+	// Skeleton LODs from the skinning weight each node's bone carries. A node is evaluated at lod while its
+	// subtree carries at least lodThresholds[lod] of the total weight, lodThresholds[0] should be 0
+	void BuildLODs(const std::vector<float>& nodeInfluences, const float* lodThresholds);
+
+	// Highest lod that still evaluates the node. A parent's lod is never lower than its children's
+	const std::vector<unsigned char>& GetNodeLODs() const { return m_NodeLODs; }
+	// Animated nodes evaluated every frame at lod
+	const std::vector<unsigned int>& GetLODNodes(unsigned int lod) const { return m_LODNodes[lod]; }
+	const std::vector<BoneProxy>& GetLODBoneProxies(unsigned int lod) const { return m_LODBoneProxies[lod]; }
+
+	// Marks the nodes without a channel in any clip and without an animated ancestor as static. Static nodes
+	// are left out of every GetLODNodes list, their model space transform only needs computing once
+	void SetAnimatedNodes(const std::vector<bool>& nodeHasChannel);
+	bool IsNodeStatic(unsigned int nodeIndex) const { return m_StaticNodes[nodeIndex]; }
+	unsigned int GetNumStaticNodes() const;
+
+	// -1 if no node has that name
+	int FindNode(const std::string& nodeName) const;
+
+	// Depth-first order keeps a subtree contiguous, nodeIndex up to (not including) the returned index
+	unsigned int GetSubtreeEnd(unsigned int nodeIndex) const;
+
+private:
+	void AddNode(const aiNode* node, int parentIndex, const std::map<std::string, unsigned int>& boneNameToIndexMap, std::vector<glm::mat4>& bindLocals,
+		std::vector<FoldedNode> helpers);
+	void BuildLODLists();
+
+private:
+	std::vector<int> m_ParentIndices;
+	LocalPose m_BindPose;					// bind pose locals decomposed into translation, rotation and scale
+	std::vector<int> m_BoneIndices;			// -1 for nodes that don't drive a bone
+	std::vector<std::string> m_NodeNames;	// only used while binding, never per frame
+	std::vector<std::vector<FoldedNode>> m_FoldedChains;
+	unsigned int m_NumFoldedHelpers = 0;
+
+	std::vector<bool> m_StaticNodes;
+	std::vector<unsigned char> m_NodeLODs;
+	std::vector<unsigned int> m_LODNodes[MAX_SKELETON_LODS];		// animated nodes evaluated per frame, still depth first
+	std::vector<BoneProxy> m_LODBoneProxies[MAX_SKELETON_LODS];
+};
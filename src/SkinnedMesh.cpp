@@ -1,7 +1,10 @@
 #include "SkinnedMesh.h"
 
 #include <iostream>
+#include <algorithm>
+#include <cstddef>
 #include "Texture.h"
+#include "AssimpGLM.h"
 
 #define ARRAY_SIZE_IN_ELEMENTS(a) (sizeof(a)/sizeof(a[0]))
 
@@ -10,33 +13,18 @@
 #define TEXCOORD_LOCATION		2
 #define BONE_ID_LOCATION		3
 #define BONE_WEIGHT_LOCATION	4
-
-glm::mat4 AiMatToGLM(const aiMatrix4x4& m)
-{
-	glm::mat4 r;
-	r[0][0] = m.a1; r[1][0] = m.a2; r[2][0] = m.a3; r[3][0] = m.a4;
-	r[0][1] = m.b1; r[1][1] = m.b2; r[2][1] = m.b3; r[3][1] = m.b4;
-	r[0][2] = m.c1; r[1][2] = m.c2; r[2][2] = m.c3; r[3][2] = m.c4;
-	r[0][3] = m.d1; r[1][3] = m.d2; r[2][3] = m.d3; r[3][3] = m.d4;
-	return r;
-}
-
-glm::mat4 AiMatToGLM(const aiMatrix3x3& m)
-{
-	glm::mat4 r(1.0f);
-	r[0][0] = m.a1; r[1][0] = m.a2; r[2][0] = m.a3;
-	r[0][1] = m.b1; r[1][1] = m.b2; r[2][1] = m.b3;
-	r[0][2] = m.c1; r[1][2] = m.c2; r[2][2] = m.c3;
-
-	return r;
-}
+#define INSTANCE_ANIMATION_LOCATION	5
+#define INSTANCE_OFFSET_LOCATION	6
 
 SkinnedMesh::~SkinnedMesh()
 {
 	// TODO: Clear
+
+	for (AnimationClip* clip : m_Clips)
+		delete clip;
 }
 
-bool SkinnedMesh::LoadMesh(const std::string& filename)
+bool SkinnedMesh::LoadMesh(const std::string& filename, const AnimationImportSettings& importSettings)
 {
 	glGenVertexArrays(1, &m_VAO);
 	glBindVertexArray(m_VAO);
@@ -45,12 +33,15 @@ bool SkinnedMesh::LoadMesh(const std::string& filename)
 
 	bool ret = false;
 
-	m_Scene = m_Importer.ReadFile(filename, aiProcess_Triangulate | aiProcess_GenNormals | aiProcess_JoinIdenticalVertices);
+	// the importer and its scene only live for the duration of the import, everything
+	// needed at runtime is copied into engine owned structures
+	Assimp::Importer importer;
+	const aiScene* scene = importer.ReadFile(filename, aiProcess_Triangulate | aiProcess_GenNormals | aiProcess_JoinIdenticalVertices);
 
-	if (m_Scene)
-		ret = InitFromScene(m_Scene, filename);
+	if (scene)
+		ret = InitFromScene(scene, filename, importSettings);
 	else
-		printf("Error loading '%s': %s", filename.c_str(), m_Importer.GetErrorString());
+		printf("Error loading '%s': %s", filename.c_str(), importer.GetErrorString());
 
 	glBindVertexArray(0);
 
@@ -61,6 +52,11 @@ void SkinnedMesh::Render()
 {
 	glBindVertexArray(m_VAO);
 
+	// the instance arrays share the VAO, a single draw reads the constant zero offset instead
+	glDisableVertexAttribArray(INSTANCE_ANIMATION_LOCATION);
+	glDisableVertexAttribArray(INSTANCE_OFFSET_LOCATION);
+	glVertexAttrib4f(INSTANCE_OFFSET_LOCATION, 0.0f, 0.0f, 0.0f, 1.0f);
+
 	for (unsigned int i = 0; i < m_Meshes.size(); i++)
 	{
 		unsigned int materialIndex = m_Meshes[i].MaterialIndex;
@@ -76,7 +72,48 @@ void SkinnedMesh::Render()
 	glBindVertexArray(0);
 }
 
-bool SkinnedMesh::InitFromScene(const aiScene* scene, const std::string& filename)
+void SkinnedMesh::SetBakedInstances(const std::vector<BakedInstance>& instances)
+{
+	glBindVertexArray(m_VAO);
+
+	glBindBuffer(GL_ARRAY_BUFFER, m_Buffers[BufferType::INSTANCE_VB]);
+	glBufferData(GL_ARRAY_BUFFER, sizeof(BakedInstance) * instances.size(), instances.data(), GL_STATIC_DRAW);
+
+	// RenderInstanced enables the arrays, Render disables them again
+	glVertexAttribPointer(INSTANCE_ANIMATION_LOCATION, 4, GL_FLOAT, GL_FALSE, sizeof(BakedInstance), (const void*)offsetof(BakedInstance, Animation));
+	glVertexAttribDivisor(INSTANCE_ANIMATION_LOCATION, 1);
+
+	glVertexAttribPointer(INSTANCE_OFFSET_LOCATION, 4, GL_FLOAT, GL_FALSE, sizeof(BakedInstance), (const void*)offsetof(BakedInstance, Offset));
+	glVertexAttribDivisor(INSTANCE_OFFSET_LOCATION, 1);
+
+	glBindVertexArray(0);
+
+	m_NumInstances = (unsigned int)instances.size();
+}
+
+void SkinnedMesh::RenderInstanced()
+{
+	glBindVertexArray(m_VAO);
+	glEnableVertexAttribArray(INSTANCE_ANIMATION_LOCATION);
+	glEnableVertexAttribArray(INSTANCE_OFFSET_LOCATION);
+
+	for (unsigned int i = 0; i < m_Meshes.size(); i++)
+	{
+		unsigned int materialIndex = m_Meshes[i].MaterialIndex;
+		m_Textures[materialIndex]->SetActive();
+
+		glDrawElementsInstancedBaseVertex(	GL_TRIANGLES,
+											m_Meshes[i].NumIndices,
+											GL_UNSIGNED_INT,
+											(void*)(sizeof(unsigned int) * m_Meshes[i].BaseIndex),
+											m_NumInstances,
+											m_Meshes[i].BaseVertex );
+	}
+
+	glBindVertexArray(0);
+}
+
+bool SkinnedMesh::InitFromScene(const aiScene* scene, const std::string& filename, const AnimationImportSettings& importSettings)
 {
 	m_Meshes.resize(scene->mNumMeshes);
 	m_Textures.resize(scene->mNumMaterials);
@@ -94,6 +131,352 @@ bool SkinnedMesh::InitFromScene(const aiScene* scene, const std::string& filenam
 		return false;
 
 	PopulateBuffers();
+
+	m_Skeleton.Build(scene->mRootNode, m_BoneNameToIndexMap);
+	BuildSkeletonLODs();
+	m_GlobalTransforms.resize(m_Skeleton.GetNumNodes());
+
+	// this transform to cancel out any transformations on rootnode
+	m_GlobalInverseTransform = AffineFromMat4(glm::inverse(AiMatToGLM(scene->mRootNode->mTransformation)));
+
+	AddClips(scene, importSettings);
+	ClassifyStaticNodes();
+
+	// nodes without a channel are never written by the sampler and keep their bind pose
+	m_LocalPose = m_Skeleton.GetBindPose();
+	m_FadePose = m_Skeleton.GetBindPose();
+	m_BlendedPose = m_Skeleton.GetBindPose();
+	m_SnapshotPose = m_Skeleton.GetBindPose();
+	m_BlendWeights.resize(m_BlendedPose.PositionX.size());
+
+	if (!m_Clips.empty())
+		SetActiveClip(0);
+
+	return true;
+}
+
+bool SkinnedMesh::LoadAnimations(const std::string& filename, const AnimationImportSettings& importSettings)
+{
+	Assimp::Importer importer;
+	const aiScene* scene = importer.ReadFile(filename, 0);
+
+	if (!scene)
+	{
+		printf("Error loading '%s': %s", filename.c_str(), importer.GetErrorString());
+		return false;
+	}
+
+	bool hadClips = !m_Clips.empty();
+
+	AddClips(scene, importSettings);
+	ClassifyStaticNodes();
+
+	if (!hadClips && !m_Clips.empty())
+		SetActiveClip(0);
+
+	return true;
+}
+
+void SkinnedMesh::AddClips(const aiScene* scene, const AnimationImportSettings& importSettings)
+{
+	// clips only read the skeleton while they resample, reduce and compress
+	std::vector<AnimationClip*> clips(scene->mNumAnimations);
+	ParallelFor(m_JobSystem, scene->mNumAnimations, 1, [&](unsigned int begin, unsigned int end, unsigned int /*workerIndex*/)
+	{
+		for (unsigned int i = begin; i < end; i++)
+		{
+			clips[i] = new AnimationClip();
+			clips[i]->Load(scene->mAnimations[i], m_Skeleton, importSettings);
+		}
+	});
+
+	for (AnimationClip* clip : clips)
+	{
+		// a later clip with the same name is still reachable by index
+		if (m_ClipNameToIndexMap.find(clip->GetName()) == m_ClipNameToIndexMap.end())
+			m_ClipNameToIndexMap[clip->GetName()] = (unsigned int)m_Clips.size();
+
+		m_Clips.push_back(clip);
+
+		printf("Loaded clip %u '%s'\n", (unsigned int)m_Clips.size() - 1, clip->GetName().c_str());
+	}
+
+	// sized for the largest clip, so switching clips and cross fading never allocate
+	unsigned int maxChannels = 0;
+	for (const AnimationClip* clip : m_Clips)
+		maxChannels = glm::max(maxChannels, clip->GetNumChannels());
+
+	m_Sampler.Reserve(maxChannels);
+	m_FadeSampler.Reserve(maxChannels);
+}
+
+int SkinnedMesh::FindClip(const std::string& clipName) const
+{
+	auto it = m_ClipNameToIndexMap.find(clipName);
+	return it != m_ClipNameToIndexMap.end() ? (int)it->second : -1;
+}
+
+void SkinnedMesh::SetActiveClip(unsigned int clipIndex)
+{
+	assert(clipIndex < m_Clips.size());
+
+	m_ActiveClip = clipIndex;
+	m_ActiveClipStartTime = 0.0;
+	m_FadeClip = -1;
+	m_ActiveBlendSpace = -1;
+	m_SnapshotFadeDuration = 0.0f;
+	m_Sampler.Bind(m_Clips[clipIndex], nullptr, m_Skeleton.GetNodeLODs().data());
+
+	// nodes the previous clip animated but this one doesn't go back to their bind pose
+	m_LocalPose = m_Skeleton.GetBindPose();
+}
+
+void SkinnedMesh::CrossFade(unsigned int clipIndex, double timeInSeconds, float fadeDuration)
+{
+	assert(clipIndex < m_Clips.size());
+
+	// a fade that is still running snaps to its target
+	if (IsCrossFading())
+		FinishCrossFade();
+
+	if (fadeDuration <= 0.0f)
+	{
+		SetActiveClip(clipIndex);
+		m_ActiveClipStartTime = timeInSeconds;
+		return;
+	}
+
+	m_FadeClip = (int)clipIndex;
+	m_FadeStartTime = timeInSeconds;
+	m_FadeDuration = fadeDuration;
+	m_FadeSampler.Bind(m_Clips[clipIndex], nullptr, m_Skeleton.GetNodeLODs().data());
+	m_FadePose = m_Skeleton.GetBindPose();
+}
+
+void SkinnedMesh::FinishCrossFade()
+{
+	// the fade target already has warm key cursors and a sampled pose, keep them
+	std::swap(m_Sampler, m_FadeSampler);
+	std::swap(m_LocalPose, m_FadePose);
+
+	m_ActiveClip = (unsigned int)m_FadeClip;
+	m_ActiveClipStartTime = m_FadeStartTime;
+	m_FadeClip = -1;
+	m_ActiveBlendSpace = -1;
+
+	// the fade target replaced the pose a snapshot was fading into
+	m_SnapshotFadeDuration = 0.0f;
+}
+
+unsigned int SkinnedMesh::AddBlendSpace(const BlendSpace& blendSpace)
+{
+	m_BlendSpaces.emplace_back();
+	BlendSpaceInstance& instance = m_BlendSpaces.back();
+
+	instance.Space = blendSpace;
+	instance.Samplers.resize(blendSpace.GetNumSamples());
+	instance.Poses.assign(blendSpace.GetNumSamples(), m_Skeleton.GetBindPose());
+
+	for (unsigned int i = 0; i < blendSpace.GetNumSamples(); i++)
+	{
+		assert(blendSpace.GetSampleClip(i) < m_Clips.size());
+		instance.Samplers[i].Bind(m_Clips[blendSpace.GetSampleClip(i)], nullptr, m_Skeleton.GetNodeLODs().data());
+	}
+
+	return (unsigned int)m_BlendSpaces.size() - 1;
+}
+
+void SkinnedMesh::SetActiveBlendSpace(int blendSpaceIndex, double timeInSeconds)
+{
+	assert(blendSpaceIndex < (int)m_BlendSpaces.size());
+
+	if (blendSpaceIndex < 0)
+	{
+		SetActiveClip(m_ActiveClip);
+		m_ActiveClipStartTime = timeInSeconds;
+		return;
+	}
+
+	// every node is written by the blend, so m_LocalPose needs no reset
+	m_ActiveBlendSpace = blendSpaceIndex;
+	m_FadeClip = -1;
+	m_SnapshotFadeDuration = 0.0f;
+	m_BlendSpacePhase = 0.0f;
+	m_BlendSpaceTime = timeInSeconds;
+}
+
+void SkinnedMesh::SampleBlendSpace(double timeInSeconds, unsigned int lod)
+{
+	BlendSpaceInstance& instance = m_BlendSpaces[m_ActiveBlendSpace];
+
+	BlendSpaceContribution contributions[BlendSpace::MAX_CONTRIBUTIONS];
+	unsigned int numContributions = instance.Space.FindContributions(m_BlendSpaceParameters.x, m_BlendSpaceParameters.y, contributions);
+
+	// advance a shared phase by the weighted duration, so a walk and a run keep their feet in step
+	float duration = 0.0f;
+	for (unsigned int i = 0; i < numContributions; i++)
+	{
+		const AnimationClip* clip = m_Clips[instance.Space.GetSampleClip(contributions[i].SampleIndex)];
+		duration += contributions[i].Weight * clip->GetDuration() / clip->GetTicksPerSecond();
+	}
+
+	if (duration > 0.0f)
+	{
+		m_BlendSpacePhase = fmodf(m_BlendSpacePhase + (float)(timeInSeconds - m_BlendSpaceTime) / duration, 1.0f);
+		if (m_BlendSpacePhase < 0.0f)
+			m_BlendSpacePhase += 1.0f;
+	}
+	m_BlendSpaceTime = timeInSeconds;
+
+	// fold the samples in one at a time, each weighted against the ones before it
+	const LocalPose* blended = nullptr;
+	float accumulatedWeight = 0.0f;
+
+	for (unsigned int i = 0; i < numContributions; i++)
+	{
+		unsigned int sampleIndex = contributions[i].SampleIndex;
+		const AnimationClip* clip = m_Clips[instance.Space.GetSampleClip(sampleIndex)];
+
+		LocalPose& samplePose = instance.Poses[sampleIndex];
+		instance.Samplers[sampleIndex].Sample(m_BlendSpacePhase * clip->GetDuration(), samplePose, lod);
+
+		accumulatedWeight += contributions[i].Weight;
+
+		if (!blended)
+		{
+			blended = &samplePose;
+			continue;
+		}
+
+		std::fill(m_BlendWeights.begin(), m_BlendWeights.end(), contributions[i].Weight / accumulatedWeight);
+		AnimationSampler::BlendPoses(*blended, samplePose, m_BlendWeights.data(), m_LocalPose);
+		blended = &m_LocalPose;
+	}
+
+	// a single contribution is copied, the buffers are the same size so this doesn't allocate
+	if (blended && blended != &m_LocalPose)
+		m_LocalPose = *blended;
+}
+
+void SkinnedMesh::SetStateMachine(const AnimationStateMachine* stateMachine, double timeInSeconds)
+{
+	m_StateMachine = stateMachine;
+
+	if (!m_StateMachine)
+		return;
+
+	m_StateMachine->Reset(m_StateInstance, timeInSeconds);
+	EnterState(m_StateInstance.CurrentState, timeInSeconds, 0.0f);
+}
+
+void SkinnedMesh::EnterState(unsigned int stateIndex, double timeInSeconds, float blendDuration)
+{
+	const AnimationStateNode& state = m_StateMachine->GetState(stateIndex);
+
+	if (state.Type == CLIP_STATE)
+	{
+		CrossFade(state.Index, timeInSeconds, blendDuration);
+		return;
+	}
+
+	// cross fades only target clips, so a blend space fades in from a snapshot of the outgoing pose instead.
+	// The snapshot is sampled at full detail, a pose buffer allocated at load holds it
+	bool fadeIn = blendDuration > 0.0f && (m_ActiveBlendSpace >= 0 || !m_Clips.empty());
+	if (fadeIn)
+		m_SnapshotPose = *SampleBasePose(timeInSeconds, 0);
+
+	SetActiveBlendSpace((int)state.Index, timeInSeconds);
+
+	if (fadeIn)
+	{
+		m_SnapshotFadeStartTime = timeInSeconds;
+		m_SnapshotFadeDuration = blendDuration;
+	}
+}
+
+void SkinnedMesh::UpdateStateMachine(double timeInSeconds)
+{
+	const AnimationTransition* transition = m_StateMachine->Update(m_StateInstance, timeInSeconds);
+
+	if (transition)
+		EnterState(transition->TargetState, timeInSeconds, transition->BlendDuration);
+
+	const AnimationStateNode& state = m_StateMachine->GetState(m_StateInstance.CurrentState);
+
+	if (state.Type == BLEND_SPACE_STATE)
+		SetBlendSpaceParameters(m_StateInstance.Parameters[state.XParameter], m_StateInstance.Parameters[state.YParameter]);
+}
+
+int SkinnedMesh::CreateBoneMask(const std::vector<std::string>& subtreeRootBones)
+{
+	AlignedVector<float> mask(m_LocalPose.PositionX.size(), 0.0f);
+
+	for (const std::string& boneName : subtreeRootBones)
+	{
+		int nodeIndex = m_Skeleton.FindNode(boneName);
+
+		if (m_BoneNameToIndexMap.find(boneName) == m_BoneNameToIndexMap.end() || nodeIndex < 0)
+		{
+			printf("Bone mask root '%s' is not a bone\n", boneName.c_str());
+			return -1;
+		}
+
+		std::fill(mask.begin() + nodeIndex, mask.begin() + m_Skeleton.GetSubtreeEnd(nodeIndex), 1.0f);
+	}
+
+	m_BoneMasks.push_back(mask);
+	return (int)m_BoneMasks.size() - 1;
+}
+
+unsigned int SkinnedMesh::AddLayer(unsigned int clipIndex, float weight, int boneMask, double startTimeInSeconds)
+{
+	assert(clipIndex < m_Clips.size() && boneMask < (int)m_BoneMasks.size());
+
+	const AnimationClip* clip = m_Clips[clipIndex];
+
+	m_Layers.emplace_back();
+	AnimationLayer& layer = m_Layers.back();
+
+	layer.ClipIndex = clipIndex;
+	layer.Additive = clip->IsAdditive();
+	layer.StartTime = startTimeInSeconds;
+	layer.Pose.Resize(m_Skeleton.GetNumNodes());
+
+	// nodes the clip doesn't animate keep the pose below the layer
+	layer.NodeMask.resize(layer.Pose.PositionX.size(), 0.0f);
+	for (unsigned int i = 0; i < m_Skeleton.GetNumNodes(); i++)
+	{
+		if (clip->GetNodeChannel(i) >= 0)
+			layer.NodeMask[i] = boneMask >= 0 ? m_BoneMasks[boneMask][i] : 1.0f;
+	}
+
+	layer.Sampler.Bind(clip, layer.NodeMask.data(), m_Skeleton.GetNodeLODs().data());
+	layer.Weights.resize(layer.NodeMask.size());
+
+	unsigned int layerIndex = (unsigned int)m_Layers.size() - 1;
+	SetLayerWeight(layerIndex, weight);
+
+	return layerIndex;
+}
+
+void SkinnedMesh::SetLayerWeight(unsigned int layerIndex, float weight)
+{
+	AnimationLayer& layer = m_Layers[layerIndex];
+
+	layer.Weight = weight;
+	for (unsigned int i = 0; i < layer.Weights.size(); i++)
+		layer.Weights[i] = layer.NodeMask[i] * weight;
+}
+
+bool SkinnedMesh::SetActiveClip(const std::string& clipName)
+{
+	int clipIndex = FindClip(clipName);
+
+	if (clipIndex < 0)
+		return false;
+
+	SetActiveClip((unsigned int)clipIndex);
+	return true;
 }
 
 void SkinnedMesh::CountVerticesAndIndices(const aiScene* scene, unsigned int& numVertices, unsigned int& numIndices)
@@ -112,44 +495,51 @@ void SkinnedMesh::CountVerticesAndIndices(const aiScene* scene, unsigned int& nu
 
 void SkinnedMesh::ReserveSpaces(unsigned int numVertices, unsigned int numIndices)
 {
-	m_Positions.reserve(numVertices);
-	m_Normals.reserve(numVertices);
-	m_TexCoords.reserve(numVertices);
-	m_Indices.reserve(numIndices);
+	m_Positions.resize(numVertices);
+	m_Normals.resize(numVertices);
+	m_TexCoords.resize(numVertices);
+	m_Indices.resize(numIndices);
 	m_Bones.resize(numVertices);
 }
 
 void SkinnedMesh::InitAllMeshes(const aiScene* scene)
 {
-	for (unsigned int i = 0; i < scene->mNumMeshes; i++)
+	// every mesh copies into its own range of the buffers, so meshes import in parallel
+	ParallelFor(m_JobSystem, scene->mNumMeshes, 1, [&](unsigned int begin, unsigned int end, unsigned int /*workerIndex*/)
 	{
-		const aiMesh* mesh = scene->mMeshes[i];
-		InitSingleMesh(i, mesh);
-	}
+		for (unsigned int i = begin; i < end; i++)
+			InitSingleMesh(i, scene->mMeshes[i]);
+	});
+
+	// bone ids are handed out in mesh order, so bones stay on this thread
+	for (unsigned int i = 0; i < scene->mNumMeshes; i++)
+		LoadMeshBones(i, scene->mMeshes[i]);
 }
 
 void SkinnedMesh::InitSingleMesh(unsigned int meshIndex, const aiMesh* mesh)
 {
+	unsigned int baseVertex = m_Meshes[meshIndex].BaseVertex;
+
 	for (unsigned int i = 0; i < mesh->mNumVertices; i++)
 	{
 		const aiVector3D& pos = mesh->mVertices[i];
 		const aiVector3D& normal = mesh->mNormals[i];
 		const aiVector3D& texCoords = mesh->HasTextureCoords(0) ? mesh->mTextureCoords[0][i] : aiVector3D(0, 0, 0);
 
-		m_Positions.push_back(glm::vec3(pos.x, pos.y, pos.z));
-		m_Normals.push_back(glm::vec3(normal.x, normal.y, normal.z));
-		m_TexCoords.push_back(glm::vec2(texCoords.x, texCoords.y));
+		m_Positions[baseVertex + i] = glm::vec3(pos.x, pos.y, pos.z);
+		m_Normals[baseVertex + i] = glm::vec3(normal.x, normal.y, normal.z);
+		m_TexCoords[baseVertex + i] = glm::vec2(texCoords.x, texCoords.y);
 	}
 
-	LoadMeshBones(meshIndex, mesh);
+	unsigned int* indices = &m_Indices[m_Meshes[meshIndex].BaseIndex];
 
 	for (unsigned int i = 0; i < mesh->mNumFaces; i++)
 	{
 		const aiFace& face = mesh->mFaces[i];
 		assert(face.mNumIndices == 3);
-		m_Indices.push_back(face.mIndices[0]);
-		m_Indices.push_back(face.mIndices[1]);
-		m_Indices.push_back(face.mIndices[2]);
+		indices[i * 3 + 0] = face.mIndices[0];
+		indices[i * 3 + 1] = face.mIndices[1];
+		indices[i * 3 + 2] = face.mIndices[2];
 	}
 }
 
@@ -193,168 +583,322 @@ int SkinnedMesh::GetBoneId(const aiBone* bone)
 	return boneId;
 }
 
-void SkinnedMesh::GetBoneTransforms(double timeInSeconds, std::vector<glm::mat4>& transforms)
+unsigned int SkinnedMesh::s_NextUpdateSlot = 0;
+
+void SkinnedMesh::SetUpdateInterval(unsigned int updateInterval)
 {
-	transforms.resize(m_BoneInfos.size());
+	m_UpdateInterval = glm::max(updateInterval, 1u);
+}
 
-	double ticksPerSecond = m_Scene->mAnimations[0]->mTicksPerSecond != 0 ? m_Scene->mAnimations[0]->mTicksPerSecond : 25.0;
-	double timeInTicks = timeInSeconds * ticksPerSecond;
-	double animTimeInTicks = fmod(timeInTicks, m_Scene->mAnimations[0]->mDuration);
+unsigned int SkinnedMesh::SelectUpdateInterval(float distanceToCamera, float fullRateDistance)
+{
+	unsigned int updateInterval = 1;
+	while (updateInterval < 8 && distanceToCamera > fullRateDistance * updateInterval)
+		updateInterval *= 2;
 
-	// this transform to cancel out any transformations on rootnode
-	glm::mat4 m_GlobalInverseTransform = glm::inverse(AiMatToGLM(m_Scene->mRootNode->mTransformation));
-	ReadNodeHierarchy(animTimeInTicks, m_Scene->mRootNode, m_GlobalInverseTransform);
+	return updateInterval;
+}
 
-	for (unsigned int i = 0; i < m_BoneInfos.size(); i++)
-		transforms[i] = m_BoneInfos[i].FinalTransformation;
+static void InterpolatePalettes(const std::vector<glm::mat4>& a, const std::vector<glm::mat4>& b, float factor, std::vector<glm::mat4>& out)
+{
+	out.resize(a.size());
+	for (size_t i = 0; i < a.size(); i++)
+		out[i] = a[i] + (b[i] - a[i]) * factor;
 }
 
-void SkinnedMesh::ReadNodeHierarchy(double animationTimeInTicks, const aiNode* node, const glm::mat4& parentTransform)
+void SkinnedMesh::GetBoneTransforms(double timeInSeconds, std::vector<glm::mat4>& transforms, unsigned int lod)
 {
-	std::string nodeName = node->mName.C_Str();
-	const aiAnimation* animation = m_Scene->mAnimations[0];
+	bool outsideInterval = m_TargetPalette.empty() || timeInSeconds < m_SourceTime || timeInSeconds > m_TargetTime;
 
-	glm::mat4 nodeTransform = AiMatToGLM(node->mTransformation);
+	// the step since the last call only predicts the next one if there was a last call and time didn't jump
+	// out of a running interval. A held interval (target at the source) is left every frame and is no jump
+	bool jumped = outsideInterval && m_TargetTime > m_SourceTime;
+	double frameTime = m_HasUpdated && !jumped ? glm::max(timeInSeconds - m_LastUpdateTime, 0.0) : 0.0;
+	m_LastUpdateTime = timeInSeconds;
+	m_HasUpdated = true;
 
-	const aiNodeAnim* nodeAnim = FindNodeAnim(animation, nodeName);
+	if (m_UpdateInterval <= 1)
+	{
+		EvaluateBoneTransforms(timeInSeconds, transforms, lod);
+		return;
+	}
 
-	if (nodeAnim)
+	if (m_UpdateCounter++ % m_UpdateInterval == 0 || outsideInterval)
 	{
-		aiVector3D scaling;
-		CalcInterpolatedScaling(scaling, animationTimeInTicks, nodeAnim);
-		glm::mat4 scalingMat = glm::scale(glm::mat4(1), glm::vec3(scaling.x, scaling.y, scaling.z));
+		// continue from what is on screen now, so switching targets never pops
+		if (outsideInterval)
+			EvaluateBoneTransforms(timeInSeconds, m_SourcePalette, lod);
+		else
+		{
+			float factor = m_TargetTime > m_SourceTime ? (float)((timeInSeconds - m_SourceTime) / (m_TargetTime - m_SourceTime)) : 1.0f;
+			InterpolatePalettes(m_SourcePalette, m_TargetPalette, factor, m_SourcePalette);
+		}
+
+		// evaluate where the mesh will be at its next update, assuming the frame rate holds.
+		// Without a frame time the current pose is held until the next call measures one
+		m_SourceTime = timeInSeconds;
+		m_TargetTime = timeInSeconds + frameTime * m_UpdateInterval;
 
-		aiQuaternion rotation;
-		CalcInterpolatedRotation(rotation, animationTimeInTicks, nodeAnim);
-		glm::mat4 rotationMat = AiMatToGLM(rotation.GetMatrix());
+		if (frameTime > 0.0)
+			EvaluateBoneTransforms(m_TargetTime, m_TargetPalette, lod);
+		else
+			m_TargetPalette = m_SourcePalette;
+	}
 
-		aiVector3D position;
-		CalcInterpolatedPosition(position, animationTimeInTicks, nodeAnim);
-		glm::mat4 positionMat = glm::translate(glm::mat4(1.0f), glm::vec3(position.x, position.y, position.z));
+	float factor = m_TargetTime > m_SourceTime ? (float)((timeInSeconds - m_SourceTime) / (m_TargetTime - m_SourceTime)) : 1.0f;
+	InterpolatePalettes(m_SourcePalette, m_TargetPalette, factor, transforms);
+}
 
-		nodeTransform = positionMat * rotationMat * scalingMat;
+void SkinnedMesh::EvaluateBoneTransforms(double timeInSeconds, std::vector<glm::mat4>& transforms, unsigned int lod)
+{
+	transforms.resize(m_BoneInfos.size());
+	lod = glm::min(lod, MAX_SKELETON_LODS - 1u);
+
+	if (m_StateMachine)
+		UpdateStateMachine(timeInSeconds);
+
+	if (IsCrossFading() && timeInSeconds - m_FadeStartTime >= m_FadeDuration)
+		FinishCrossFade();
+
+	if (IsFadingFromSnapshot() && timeInSeconds - m_SnapshotFadeStartTime >= m_SnapshotFadeDuration)
+		m_SnapshotFadeDuration = 0.0f;
+
+	// the palette then only depends on the clip and the time, so it can come from the shared cache
+	const AnimationClip* cachedClip = nullptr;
+	unsigned int cacheBucket = 0;
+
+	if (m_PoseCache && IsPlayingSingleClip())
+	{
+		cachedClip = m_Clips[m_ActiveClip];
+		double clipTime = cachedClip->GetAnimationTimeInTicks(timeInSeconds - m_ActiveClipStartTime) / cachedClip->GetTicksPerSecond();
+		cacheBucket = m_PoseCache->GetBucket(clipTime);
+
+		const std::vector<glm::mat4>* palette = m_PoseCache->Find(cachedClip, cacheBucket, lod);
+		if (palette)
+		{
+			transforms = *palette;
+			return;
+		}
+
+		// sample at the bucket start so every instance in the bucket gets the same palette
+		timeInSeconds = m_ActiveClipStartTime + m_PoseCache->GetBucketTime(cacheBucket);
 	}
 
-	glm::mat4 globalTransformation = parentTransform * nodeTransform;
+	const LocalPose* pose = SampleBasePose(timeInSeconds, lod);
 
-	if (m_BoneNameToIndexMap.find(nodeName) != m_BoneNameToIndexMap.end())
+	for (AnimationLayer& layer : m_Layers)
 	{
-		unsigned int boneIndex = m_BoneNameToIndexMap[nodeName];
-		m_BoneInfos[boneIndex].FinalTransformation = globalTransformation * m_BoneInfos[boneIndex].OffsetMatrix;
+		if (layer.Weight <= 0.0f)
+			continue;
+
+		const AnimationClip* clip = m_Clips[layer.ClipIndex];
+		layer.Sampler.Sample(clip->GetAnimationTimeInTicks(timeInSeconds - layer.StartTime), layer.Pose, lod);
+
+		if (layer.Additive)
+			AnimationSampler::AddPoses(*pose, layer.Pose, layer.Weights.data(), m_BlendedPose);
+		else
+			AnimationSampler::BlendPoses(*pose, layer.Pose, layer.Weights.data(), m_BlendedPose);
+		pose = &m_BlendedPose;
 	}
 
-	for (unsigned int i = 0; i < node->mNumChildren; i++)
-		ReadNodeHierarchy(animationTimeInTicks, node->mChildren[i], globalTransformation);
+	ReadNodeHierarchy(*pose, lod);
+
+	for (unsigned int i = 0; i < m_BoneInfos.size(); i++)
+		transforms[i] = m_BoneInfos[i].FinalTransformation;
+
+	if (cachedClip)
+		m_PoseCache->Insert(cachedClip, cacheBucket, lod, transforms);
 }
 
-const aiNodeAnim* SkinnedMesh::FindNodeAnim(const aiAnimation* animation, const std::string& nodeName)
+const LocalPose* SkinnedMesh::SampleBasePose(double timeInSeconds, unsigned int lod)
 {
-	for (unsigned int i = 0; i < animation->mNumChannels; i++)
+	if (m_ActiveBlendSpace >= 0)
+		SampleBlendSpace(timeInSeconds, lod);
+	else if (!m_Clips.empty())
+	{
+		const AnimationClip* clip = m_Clips[m_ActiveClip];
+		m_Sampler.Sample(clip->GetAnimationTimeInTicks(timeInSeconds - m_ActiveClipStartTime), m_LocalPose, lod);
+	}
+
+	// m_LocalPose must keep the bind pose of nodes its clip doesn't animate, so
+	// blending and layering always write to m_BlendedPose instead of into it
+	const LocalPose* pose = &m_LocalPose;
+
+	if (IsFadingFromSnapshot())
 	{
-		const aiNodeAnim* animNode = animation->mChannels[i];
+		float weight = glm::clamp((float)(timeInSeconds - m_SnapshotFadeStartTime) / m_SnapshotFadeDuration, 0.0f, 1.0f);
+		std::fill(m_BlendWeights.begin(), m_BlendWeights.end(), weight);
 
-		if (nodeName == animNode->mNodeName.C_Str())
-			return animNode;
+		AnimationSampler::BlendPoses(m_SnapshotPose, *pose, m_BlendWeights.data(), m_BlendedPose);
+		pose = &m_BlendedPose;
 	}
 
-	return nullptr;
+	if (IsCrossFading())
+	{
+		const AnimationClip* fadeClip = m_Clips[m_FadeClip];
+		double fadeTime = glm::max(timeInSeconds - m_FadeStartTime, 0.0);
+		m_FadeSampler.Sample(fadeClip->GetAnimationTimeInTicks(fadeTime), m_FadePose, lod);
+
+		float weight = glm::clamp((float)fadeTime / m_FadeDuration, 0.0f, 1.0f);
+		std::fill(m_BlendWeights.begin(), m_BlendWeights.end(), weight);
+
+		AnimationSampler::BlendPoses(*pose, m_FadePose, m_BlendWeights.data(), m_BlendedPose);
+		pose = &m_BlendedPose;
+	}
+
+	return pose;
 }
 
-void SkinnedMesh::CalcInterpolatedScaling(aiVector3D& outVector, double animationTimeInTicks, const aiNodeAnim* nodeAnim)
+void SkinnedMesh::InitClipScratch(ClipEvaluationScratch& scratch) const
 {
-	if (nodeAnim->mNumScalingKeys == 1)
-	{
-		outVector = nodeAnim->mScalingKeys[0].mValue;
-		return;
-	}
+	scratch.Samplers.resize(m_Clips.size());
+	scratch.Poses.assign(m_Clips.size(), m_Skeleton.GetBindPose());
 
-	unsigned int scalingIndex = FindScaling(animationTimeInTicks, nodeAnim);
-	unsigned int nextScalingIndex = scalingIndex + 1;
+	for (unsigned int i = 0; i < m_Clips.size(); i++)
+		scratch.Samplers[i].Bind(m_Clips[i], nullptr, m_Skeleton.GetNodeLODs().data());
 
-	float t1 = nodeAnim->mScalingKeys[scalingIndex].mTime;
-	float t2 = nodeAnim->mScalingKeys[nextScalingIndex].mTime;
-	float deltaTime = t2 - t1;
-	float factor = ((float)animationTimeInTicks - t1) / deltaTime;
-	const aiVector3D& start = nodeAnim->mScalingKeys[scalingIndex].mValue;
-	const aiVector3D& end = nodeAnim->mScalingKeys[nextScalingIndex].mValue;
-	aiVector3D delta = end - start;
-	outVector = start + (float)factor * delta;
+	// static nodes keep the model space transforms computed in ClassifyStaticNodes
+	scratch.LocalTransforms.resize(m_LocalTransforms.size());
+	scratch.GlobalTransforms = m_GlobalTransforms;
 }
 
-unsigned int SkinnedMesh::FindScaling(double animationTimeInTicks, const aiNodeAnim* nodeAnim)
+void SkinnedMesh::EvaluateClipBoneTransforms(unsigned int clipIndex, float animationTimeInTicks, unsigned int lod, ClipEvaluationScratch& scratch, glm::mat4* transforms) const
 {
-	for (unsigned int i = 0; i < nodeAnim->mNumScalingKeys - 1; i++)
+	lod = glm::min(lod, MAX_SKELETON_LODS - 1u);
+
+	LocalPose& pose = scratch.Poses[clipIndex];
+	scratch.Samplers[clipIndex].Sample(animationTimeInTicks, pose, lod);
+
+	const std::vector<int>& parentIndices = m_Skeleton.GetParentIndices();
+	const std::vector<int>& boneIndices = m_Skeleton.GetBoneIndices();
+
+	LocalPoseToAffine(pose, m_Skeleton.GetLODNodes(lod), scratch.LocalTransforms);
+
+	// same walk as ReadNodeHierarchy, into the scratch buffers and the caller's palette
+	for (unsigned int i : m_Skeleton.GetLODNodes(lod))
 	{
-		double t = nodeAnim->mScalingKeys[i].mTime;
-		if (animationTimeInTicks < t)
-			return i;
+		const Affine3x4& parentTransform = parentIndices[i] < 0 ? m_GlobalInverseTransform : scratch.GlobalTransforms[parentIndices[i]];
+		scratch.GlobalTransforms[i] = AffineMul(parentTransform, scratch.LocalTransforms[i]);
+
+		int boneIndex = boneIndices[i];
+		if (boneIndex >= 0)
+			AffineToMat4(AffineMul(scratch.GlobalTransforms[i], m_BoneInfos[boneIndex].OffsetTransform), transforms[boneIndex]);
 	}
-	return 0;
+
+	for (unsigned int bone : m_StaticBones)
+		transforms[bone] = m_BoneInfos[bone].FinalTransformation;
+
+	for (const BoneProxy& proxy : m_Skeleton.GetLODBoneProxies(lod))
+		transforms[proxy.Bone] = transforms[proxy.SourceBone];
 }
 
-void SkinnedMesh::CalcInterpolatedRotation(aiQuaternion& outQuaternion, double animationTimeInTicks, const aiNodeAnim* nodeAnim)
+bool SkinnedMesh::IsPlayingSingleClip() const
 {
-	if (nodeAnim->mNumRotationKeys == 1)
+	if (m_Clips.empty() || IsCrossFading() || IsFadingFromSnapshot() || m_ActiveBlendSpace >= 0)
+		return false;
+
+	for (const AnimationLayer& layer : m_Layers)
 	{
-		outQuaternion = nodeAnim->mRotationKeys[0].mValue;
-		return;
+		if (layer.Weight > 0.0f)
+			return false;
 	}
 
-	unsigned int rotationIndex = FindRotation(animationTimeInTicks, nodeAnim);
-	unsigned int nextRotationIndex = rotationIndex + 1;
-
-	float t1 = nodeAnim->mRotationKeys[rotationIndex].mTime;
-	float t2 = nodeAnim->mRotationKeys[nextRotationIndex].mTime;
-	float deltaTime = t2 - t1;
-	float factor = ((float)animationTimeInTicks - t1) / deltaTime;
-	const aiQuaternion& start = nodeAnim->mRotationKeys[rotationIndex].mValue;
-	const aiQuaternion& end = nodeAnim->mRotationKeys[nextRotationIndex].mValue;
-	aiQuaternion::Interpolate(outQuaternion, start, end, factor);
-	//outQuaternion = start;
-	outQuaternion.Normalize();
+	return true;
 }
 
-unsigned int SkinnedMesh::FindRotation(double animationTimeInTicks, const aiNodeAnim* nodeAnim)
+// Share of the skinning weight a subtree needs to stay evaluated at each skeleton LOD
+static const float s_SkeletonLODThresholds[MAX_SKELETON_LODS] = { 0.0f, 0.002f, 0.01f, 0.03f };
+
+void SkinnedMesh::BuildSkeletonLODs()
 {
-	for (unsigned int i = 0; i < nodeAnim->mNumRotationKeys - 1; i++)
+	std::vector<float> boneInfluences(m_BoneInfos.size(), 0.0f);
+	for (const VertexBoneData& vertex : m_Bones)
 	{
-		double t = nodeAnim->mRotationKeys[i].mTime;
-		if (animationTimeInTicks < t)
-			return i;
+		for (unsigned int i = 0; i < MAX_NUM_BONES_PER_VERTEX; i++)
+			boneInfluences[vertex.BoneIds[i]] += vertex.Weights[i];
 	}
-	return 0;
+
+	const std::vector<int>& boneIndices = m_Skeleton.GetBoneIndices();
+	std::vector<float> nodeInfluences(m_Skeleton.GetNumNodes(), 0.0f);
+	for (unsigned int i = 0; i < nodeInfluences.size(); i++)
+	{
+		if (boneIndices[i] >= 0)
+			nodeInfluences[i] = boneInfluences[boneIndices[i]];
+	}
+
+	m_Skeleton.BuildLODs(nodeInfluences, s_SkeletonLODThresholds);
+
+	printf("Skeleton LODs:");
+	for (unsigned int lod = 0; lod < MAX_SKELETON_LODS; lod++)
+		printf(" %u", GetNumLODNodes(lod));
+	printf(" nodes\n");
 }
 
-void SkinnedMesh::CalcInterpolatedPosition(aiVector3D& outVector, double animationTimeInTicks, const aiNodeAnim* nodeAnim)
+// Nodes no clip animates, down a chain of nodes no clip animates either, never move. Their model space
+// transforms and palette entries are computed once here, and ReadNodeHierarchy only walks the rest
+void SkinnedMesh::ClassifyStaticNodes()
 {
-	if (nodeAnim->mNumPositionKeys == 1)
+	unsigned int numNodes = m_Skeleton.GetNumNodes();
+
+	std::vector<bool> nodeHasChannel(numNodes, false);
+	for (const AnimationClip* clip : m_Clips)
 	{
-		outVector = nodeAnim->mPositionKeys[0].mValue;
-		return;
+		for (unsigned int i = 0; i < numNodes; i++)
+		{
+			if (clip->GetNodeChannel(i) >= 0)
+				nodeHasChannel[i] = true;
+		}
 	}
 
-	unsigned int positionIndex = FindPosition(animationTimeInTicks, nodeAnim);
-	unsigned int nextPositionIndex = positionIndex + 1;
+	m_Skeleton.SetAnimatedNodes(nodeHasChannel);
+
+	const std::vector<int>& parentIndices = m_Skeleton.GetParentIndices();
+	const std::vector<int>& boneIndices = m_Skeleton.GetBoneIndices();
+
+	LocalPoseToAffine(m_Skeleton.GetBindPose(), m_LocalTransforms);
+	m_StaticBones.clear();
+
+	for (unsigned int i = 0; i < numNodes; i++)
+	{
+		if (!m_Skeleton.IsNodeStatic(i))
+			continue;
+
+		const Affine3x4& parentTransform = parentIndices[i] < 0 ? m_GlobalInverseTransform : m_GlobalTransforms[parentIndices[i]];
+		m_GlobalTransforms[i] = AffineMul(parentTransform, m_LocalTransforms[i]);
+
+		int boneIndex = boneIndices[i];
+		if (boneIndex >= 0)
+		{
+			AffineToMat4(AffineMul(m_GlobalTransforms[i], m_BoneInfos[boneIndex].OffsetTransform), m_BoneInfos[boneIndex].FinalTransformation);
+			m_StaticBones.push_back(boneIndex);
+		}
+	}
 
-	float t1 = nodeAnim->mPositionKeys[positionIndex].mTime;
-	float t2 = nodeAnim->mPositionKeys[nextPositionIndex].mTime;
-	float deltaTime = t2 - t1;
-	float factor = ((float)animationTimeInTicks - t1) / deltaTime;
-	const aiVector3D& start = nodeAnim->mPositionKeys[positionIndex].mValue;
-	const aiVector3D& end = nodeAnim->mPositionKeys[nextPositionIndex].mValue;
-	aiVector3D delta = end - start;
-	outVector = start + (float)factor * delta;
+	printf("Static nodes: %u of %u\n", m_Skeleton.GetNumStaticNodes(), numNodes);
 }
 
-unsigned int SkinnedMesh::FindPosition(double animationTimeInTicks, const aiNodeAnim* nodeAnim)
+void SkinnedMesh::ReadNodeHierarchy(const LocalPose& pose, unsigned int lod)
 {
-	for (unsigned int i = 0; i < nodeAnim->mNumPositionKeys - 1; i++)
+	const std::vector<int>& parentIndices = m_Skeleton.GetParentIndices();
+	const std::vector<int>& boneIndices = m_Skeleton.GetBoneIndices();
+
+	// only the LOD's animated nodes are converted and walked. They keep the depth first order, so parents
+	// still come first. Static nodes were computed in ClassifyStaticNodes and are never touched again
+	LocalPoseToAffine(pose, m_Skeleton.GetLODNodes(lod), m_LocalTransforms);
+
+	for (unsigned int i : m_Skeleton.GetLODNodes(lod))
 	{
-		double t = nodeAnim->mPositionKeys[i].mTime;
-		if (animationTimeInTicks < t)
-			return i;
+		// parents always come before their children, so their global transform is already up to date
+		const Affine3x4& parentTransform = parentIndices[i] < 0 ? m_GlobalInverseTransform : m_GlobalTransforms[parentIndices[i]];
+		m_GlobalTransforms[i] = AffineMul(parentTransform, m_LocalTransforms[i]);
+
+		int boneIndex = boneIndices[i];
+		if (boneIndex >= 0)
+			AffineToMat4(AffineMul(m_GlobalTransforms[i], m_BoneInfos[boneIndex].OffsetTransform), m_BoneInfos[boneIndex].FinalTransformation);
 	}
-	return 0;
+
+	for (const BoneProxy& proxy : m_Skeleton.GetLODBoneProxies(lod))
+		m_BoneInfos[proxy.Bone].FinalTransformation = m_BoneInfos[proxy.SourceBone].FinalTransformation;
 }
 
 bool SkinnedMesh::InitMaterials(const aiScene* scene, const std::string& filename)
@@ -363,6 +907,9 @@ bool SkinnedMesh::InitMaterials(const aiScene* scene, const std::string& filenam
 
 	bool ret = true;
 
+	std::vector<std::string> texturePaths(scene->mNumMaterials);
+	std::vector<Texture*> textures(scene->mNumMaterials, nullptr);
+
 	for (unsigned int i = 0; i < scene->mNumMaterials; i++)
 	{
 		const aiMaterial* mat = scene->mMaterials[i];
@@ -370,21 +917,39 @@ bool SkinnedMesh::InitMaterials(const aiScene* scene, const std::string& filenam
 		{
 			aiString path;
 			mat->GetTexture(aiTextureType_DIFFUSE, 0, &path);
-			std::string texturePath = dir + path.C_Str();
-			Texture* texture = new Texture();
-			if (!texture->Load(texturePath))
-			{
-				delete texture;
-				texture = nullptr;
-				ret = false;
-			}
-			else
-				m_Textures[i] = texture;
-
-			printf("Loaded Texture '%s'\n", texturePath.c_str());
+			texturePaths[i] = dir + path.C_Str();
+			textures[i] = new Texture();
 		}
 	}
 
+	// decoding is the slow part and needs no GL context, the upload stays on this thread
+	ParallelFor(m_JobSystem, scene->mNumMaterials, 1, [&](unsigned int begin, unsigned int end, unsigned int /*workerIndex*/)
+	{
+		for (unsigned int i = begin; i < end; i++)
+		{
+			if (textures[i])
+				textures[i]->Decode(texturePaths[i]);
+		}
+	});
+
+	for (unsigned int i = 0; i < scene->mNumMaterials; i++)
+	{
+		Texture* texture = textures[i];
+		if (!texture)
+			continue;
+
+		if (!texture->Upload())
+		{
+			delete texture;
+			texture = nullptr;
+			ret = false;
+		}
+		else
+			m_Textures[i] = texture;
+
+		printf("Loaded Texture '%s'\n", texturePaths[i].c_str());
+	}
+
 	return ret;
 }
 
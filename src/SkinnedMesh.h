@@ -10,21 +10,116 @@
 #include <assimp/scene.h>
 #include <assimp/postprocess.h>
 
+#include "Skeleton.h"
+#include "AnimationClip.h"
+#include "AnimationSampler.h"
+#include "Pose.h"
+#include "AffineTransform.h"
+#include "BlendSpace.h"
+#include "AnimationStateMachine.h"
+#include "PoseCache.h"
+#include "AnimationTexture.h"
+#include "JobSystem.h"
+
 class SkinnedMesh
 {
 public:
+	// Buffers one thread needs to evaluate clips of a mesh, see EvaluateClipBoneTransforms
+	struct ClipEvaluationScratch
+	{
+		std::vector<AnimationSampler> Samplers;		// per clip
+		std::vector<LocalPose> Poses;				// per clip, so clips never see another clip's nodes
+		AlignedVector<Affine3x4> LocalTransforms;
+		AlignedVector<Affine3x4> GlobalTransforms;
+	};
+
 	SkinnedMesh() {};
 	~SkinnedMesh();
 
-	bool LoadMesh(const std::string& filename);
+	bool LoadMesh(const std::string& filename, const AnimationImportSettings& importSettings = AnimationImportSettings());
+
+	// Splits geometry import and texture decoding of later loads into jobs. nullptr loads on the calling thread
+	void SetJobSystem(JobSystem* jobSystem) { m_JobSystem = jobSystem; }
 
 	void Render();
 
+	// Draws every instance set with SetBakedInstances, skinned in the vertex shader from an AnimationTexture
+	void SetBakedInstances(const std::vector<BakedInstance>& instances);
+	void RenderInstanced();
+
 	int GetNumBones() const { return m_BoneNameToIndexMap.size(); }
-	void GetBoneTransforms(double timeInSeconds, std::vector<glm::mat4>& transforms);
+	// lod selects a skeleton LOD (0 to MAX_SKELETON_LODS - 1): only its nodes are sampled and walked,
+	// skipped bones take the palette entry of their nearest evaluated ancestor bone
+	void GetBoneTransforms(double timeInSeconds, std::vector<glm::mat4>& transforms, unsigned int lod = 0);
+	unsigned int GetNumLODNodes(unsigned int lod) const { return (unsigned int)m_Skeleton.GetLODNodes(lod).size(); }
+
+	// Update rate LOD: the skeleton is only evaluated on every updateInterval-th GetBoneTransforms call,
+	// one interval ahead of time, and the calls in between interpolate towards that palette.
+	// Meshes start at different points of the cycle, so their evaluations spread over the frames
+	void SetUpdateInterval(unsigned int updateInterval);
+	unsigned int GetUpdateInterval() const { return m_UpdateInterval; }
+
+	// 1 up to fullRateDistance, then 2, 4 and 8 each time the distance doubles
+	static unsigned int SelectUpdateInterval(float distanceToCamera, float fullRateDistance);
+
+	// Palette of one clip that only reads the mesh, so any number of threads can evaluate at once,
+	// each with its own scratch. InitClipScratch binds every clip up front, evaluating never allocates.
+	// Writes GetNumBones() matrices. Clips must not be added while other threads evaluate
+	void InitClipScratch(ClipEvaluationScratch& scratch) const;
+	void EvaluateClipBoneTransforms(unsigned int clipIndex, float animationTimeInTicks, unsigned int lod, ClipEvaluationScratch& scratch, glm::mat4* transforms) const;
+
+	// Registers every animation of another file (e.g. a Mixamo "without skin" export) against this skeleton
+	bool LoadAnimations(const std::string& filename, const AnimationImportSettings& importSettings = AnimationImportSettings());
+
+	unsigned int GetNumClips() const { return (unsigned int)m_Clips.size(); }
+	int FindClip(const std::string& clipName) const;
+	const AnimationClip& GetClip(unsigned int clipIndex) const { return *m_Clips[clipIndex]; }
+
+	// Clip sampled by GetBoneTransforms. Bindings are resolved when a clip is registered, so switching is free per frame
+	void SetActiveClip(unsigned int clipIndex);
+	bool SetActiveClip(const std::string& clipName);
+	unsigned int GetActiveClip() const { return m_ActiveClip; }
+
+	// Blends from the active clip to clipIndex over fadeDuration seconds, starting at timeInSeconds.
+	// The new clip plays from its first frame, and becomes the active clip once the fade is over
+	void CrossFade(unsigned int clipIndex, double timeInSeconds, float fadeDuration);
+	bool IsCrossFading() const { return m_FadeClip >= 0; }
+
+	// Blend spaces replace the active clip as the base pose while active. Samplers and poses for every
+	// sample are allocated here, so playing one never allocates. Returns the blend space index
+	unsigned int AddBlendSpace(const BlendSpace& blendSpace);
+
+	// Samples stay phase locked, playing the blend of their durations. -1 goes back to the active clip
+	void SetActiveBlendSpace(int blendSpaceIndex, double timeInSeconds);
+	int GetActiveBlendSpace() const { return m_ActiveBlendSpace; }
+	void SetBlendSpaceParameters(float x, float y = 0.0f) { m_BlendSpaceParameters = glm::vec2(x, y); }
+
+	// Lets a compiled state machine pick the clip or blend space to play, from the entry state at timeInSeconds.
+	// The machine is shared and must outlive the mesh, only an AnimationStateInstance is kept here. nullptr detaches
+	void SetStateMachine(const AnimationStateMachine* stateMachine, double timeInSeconds);
+	void SetStateParameter(unsigned int parameter, float value) { m_StateInstance.SetParameter(parameter, value); }
+	unsigned int GetCurrentState() const { return m_StateInstance.CurrentState; }
+
+	// Bone mask covering the subtrees under the given bones (e.g. "Spine" for the upper body).
+	// Returns -1 if a name isn't a bone of this mesh
+	int CreateBoneMask(const std::vector<std::string>& subtreeRootBones);
+
+	// Layers are applied in order on top of the base clip, in local space before the hierarchy pass.
+	// Clips imported with AnimationImportSettings::Additive are added (breathing, recoil, lean), others
+	// override the pose below them. With a bone mask only the masked bones are sampled and blended
+	unsigned int AddLayer(unsigned int clipIndex, float weight = 1.0f, int boneMask = -1, double startTimeInSeconds = 0.0);
+	void SetLayerWeight(unsigned int layerIndex, float weight);
+	unsigned int GetNumLayers() const { return (unsigned int)m_Layers.size(); }
+
+	// Shares palettes with every mesh using the same cache while only a single clip plays. The sampled
+	// time snaps to the cache's time buckets. The cache must outlive the mesh, nullptr turns it off
+	void SetPoseCache(PoseCache* poseCache) { m_PoseCache = poseCache; }
+
+	// Start keyframe searches from the last key found instead of a fresh binary search
+	void SetUseKeyCursors(bool useKeyCursors) { m_Sampler.SetUseKeyCursors(useKeyCursors); }
 
 private:	
-	bool InitFromScene(const aiScene* scene, const std::string& filename);
+	bool InitFromScene(const aiScene* scene, const std::string& filename, const AnimationImportSettings& importSettings);
 	void CountVerticesAndIndices(const aiScene* scene, unsigned int& numVertices, unsigned int& numIndices);
 	void ReserveSpaces(unsigned int numVertices, unsigned int numIndices);
 	void InitAllMeshes(const aiScene* scene);
@@ -32,19 +127,23 @@ private:
 	bool InitMaterials(const aiScene* scene, const std::string& filename);
 	void PopulateBuffers();
 
+	void AddClips(const aiScene* scene, const AnimationImportSettings& importSettings);
+
 	void LoadMeshBones(int meshIndex, const aiMesh* mesh);
 	void LoadSingleBone(int meshIndex, const aiBone* bone);
 	int GetBoneId(const aiBone* bone);
 
-	void ReadNodeHierarchy(double animationTimeInTicks, const aiNode* node, const glm::mat4& parentTransform);
-	const aiNodeAnim* FindNodeAnim(const aiAnimation* animation, const std::string& nodeName);
-
-	void CalcInterpolatedScaling(aiVector3D& outVector, double animationTimeInTicks, const aiNodeAnim* nodeAnim);
-	unsigned int FindScaling(double animationTimeInTicks, const aiNodeAnim* nodeAnim);
-	void CalcInterpolatedRotation(aiQuaternion& outQuaternion, double animationTimeInTicks, const aiNodeAnim* nodeAnim);
-	unsigned int FindRotation(double animationTimeInTicks, const aiNodeAnim* nodeAnim);
-	void CalcInterpolatedPosition(aiVector3D& outVector, double animationTimeInTicks, const aiNodeAnim* nodeAnim);
-	unsigned int FindPosition(double animationTimeInTicks, const aiNodeAnim* nodeAnim);
+	void EvaluateBoneTransforms(double timeInSeconds, std::vector<glm::mat4>& transforms, unsigned int lod);
+	void FinishCrossFade();
+	bool IsFadingFromSnapshot() const { return m_SnapshotFadeDuration > 0.0f; }
+	const LocalPose* SampleBasePose(double timeInSeconds, unsigned int lod);
+	void SampleBlendSpace(double timeInSeconds, unsigned int lod);
+	void UpdateStateMachine(double timeInSeconds);
+	void EnterState(unsigned int stateIndex, double timeInSeconds, float blendDuration);
+	bool IsPlayingSingleClip() const;
+	void BuildSkeletonLODs();
+	void ClassifyStaticNodes();
+	void ReadNodeHierarchy(const LocalPose& pose, unsigned int lod);
 
 #define MAX_NUM_BONES_PER_VERTEX 4
 #define INVALID_MATERIAL 0xFFFFFFFF
@@ -56,7 +155,8 @@ private:
 		NORMAL_VB		= 2,
 		TEXCOORD_VB		= 3,
 		BONE_VB			= 4,
-		NUM_BUFFERS		= 5 
+		INSTANCE_VB		= 5,
+		NUM_BUFFERS		= 6 
 	};
 
 	struct BasicMeshEntry
@@ -96,14 +196,33 @@ private:
 		}
 	};
 
+	struct AnimationLayer
+	{
+		unsigned int ClipIndex = 0;
+		bool Additive = false;
+		float Weight = 0.0f;
+		double StartTime = 0.0;
+		AnimationSampler Sampler;
+		LocalPose Pose;						// sampled nodes only, additive layers keep identity elsewhere
+		AlignedVector<float> NodeMask;		// bone mask restricted to the nodes the clip animates
+		AlignedVector<float> Weights;		// NodeMask * Weight, refilled only when the weight changes
+	};
+
+	struct BlendSpaceInstance
+	{
+		BlendSpace Space;
+		std::vector<AnimationSampler> Samplers;		// per sample
+		std::vector<LocalPose> Poses;				// per sample, so clips never see another clip's nodes
+	};
+
 	struct BoneInfo
 	{
-		glm::mat4 OffsetMatrix;
+		Affine3x4 OffsetTransform;
 		glm::mat4 FinalTransformation;
 
 		BoneInfo(const glm::mat4& offsetMatrix)
 		{
-			OffsetMatrix = offsetMatrix;
+			OffsetTransform = AffineFromMat4(offsetMatrix);
 			FinalTransformation = glm::mat4(0);
 		}
 	};
@@ -112,12 +231,64 @@ private:
 	GLuint m_VAO;
 	GLuint m_Buffers[BufferType::NUM_BUFFERS] = { 0 };
 
-	Assimp::Importer m_Importer;
-	const aiScene* m_Scene = nullptr;
+	unsigned int m_NumInstances = 0;
 
 	std::vector<BasicMeshEntry> m_Meshes;
 	std::vector<class Texture*> m_Textures;
 	std::vector<BoneInfo> m_BoneInfos;
+	std::vector<unsigned int> m_StaticBones;	// bones of static nodes, their FinalTransformation never changes
+
+	Skeleton m_Skeleton;
+	Affine3x4 m_GlobalInverseTransform = AffineFromMat4(glm::mat4(1.0f));
+	std::vector<AnimationClip*> m_Clips;
+	std::map<std::string, unsigned int> m_ClipNameToIndexMap;
+	unsigned int m_ActiveClip = 0;
+	double m_ActiveClipStartTime = 0.0;
+	AlignedVector<Affine3x4> m_LocalTransforms;		// local pose converted to matrices per skeleton node
+	AlignedVector<Affine3x4> m_GlobalTransforms;	// model space transform per skeleton node
+	AnimationSampler m_Sampler;
+	LocalPose m_LocalPose;
+
+	// cross fade target, the pose buffers are allocated at load so a fade never allocates
+	int m_FadeClip = -1;
+	double m_FadeStartTime = 0.0;
+	float m_FadeDuration = 0.0f;
+	AnimationSampler m_FadeSampler;
+	LocalPose m_FadePose;
+	LocalPose m_BlendedPose;
+	AlignedVector<float> m_BlendWeights;
+
+	// frozen outgoing pose a blend space state fades in from
+	LocalPose m_SnapshotPose;
+	double m_SnapshotFadeStartTime = 0.0;
+	float m_SnapshotFadeDuration = 0.0f;
+
+	std::vector<BlendSpaceInstance> m_BlendSpaces;
+	int m_ActiveBlendSpace = -1;
+	glm::vec2 m_BlendSpaceParameters = glm::vec2(0.0f);
+	float m_BlendSpacePhase = 0.0f;
+	double m_BlendSpaceTime = 0.0;
+
+	const AnimationStateMachine* m_StateMachine = nullptr;
+	AnimationStateInstance m_StateInstance;
+
+	PoseCache* m_PoseCache = nullptr;
+	JobSystem* m_JobSystem = nullptr;
+
+	// update rate LOD, the palette shown is interpolated from source to target between evaluations
+	unsigned int m_UpdateInterval = 1;
+	unsigned int m_UpdateCounter = s_NextUpdateSlot++;
+	double m_LastUpdateTime = 0.0;
+	bool m_HasUpdated = false;
+	double m_SourceTime = 0.0;
+	double m_TargetTime = 0.0;
+	std::vector<glm::mat4> m_SourcePalette;
+	std::vector<glm::mat4> m_TargetPalette;
+
+	static unsigned int s_NextUpdateSlot;
+
+	std::vector<AnimationLayer> m_Layers;
+	std::vector<AlignedVector<float>> m_BoneMasks;	// 1 or 0 per skeleton node
 
 	std::vector<glm::vec3> m_Positions;
 	std::vector<glm::vec3> m_Normals;
@@ -9,6 +9,8 @@ Texture::Texture()
 	m_Id = 0;
 	m_Width = 0;
 	m_Height = 0;
+	m_NumChannels = 0;
+	m_Data = nullptr;
 }
 
 Texture::~Texture()
@@ -18,19 +20,35 @@ Texture::~Texture()
 
 bool Texture::Load(const std::string& filepath)
 {
-	Clear();
+	return Decode(filepath) && Upload();
+}
 
-	int nrChannels;
+bool Texture::Decode(const std::string& filepath)
+{
+	Clear();
 
-	stbi_set_flip_vertically_on_load(true);
-	unsigned char* data = stbi_load(filepath.c_str(), &m_Width, &m_Height, &nrChannels, 0);
+	// the flag is per thread, so decodes running in parallel don't race on it
+	stbi_set_flip_vertically_on_load_thread(true);
+	m_Data = stbi_load(filepath.c_str(), &m_Width, &m_Height, &m_NumChannels, 0);
 
-	if (!data)
+	if (!m_Data)
 	{
 		printf("Failed to load texture '%s'\n", filepath.c_str());
 		return false;
 	}
 
+	return true;
+}
+
+bool Texture::Upload()
+{
+	if (!m_Data)
+		return false;
+
+	int nrChannels = m_NumChannels;
+	unsigned char* data = m_Data;
+	m_Data = nullptr;
+
 	GLenum format;
 	if (nrChannels == 1) format = GL_RED;
 	else if (nrChannels == 3) format = GL_RGB;
@@ -38,6 +56,7 @@ bool Texture::Load(const std::string& filepath)
 	else
 	{
 		printf("%d channeled images are not supported\n", nrChannels);
+		stbi_image_free(data);
 		return false;
 	}
 
@@ -64,6 +83,12 @@ void Texture::SetActive(int slot)
 
 void Texture::Clear()
 {
+	if (m_Data)
+	{
+		stbi_image_free(m_Data);
+		m_Data = nullptr;
+	}
+
 	if(m_Id != 0)
 	{
 		glDeleteTextures(1, &m_Id);
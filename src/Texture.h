@@ -9,6 +9,12 @@ public:
 	~Texture();
 
 	bool Load(const std::string& filepath);
+
+	// Load split in two: Decode only reads the file, so it can run on any thread,
+	// and Upload creates the GL texture on the thread owning the context
+	bool Decode(const std::string& filepath);
+	bool Upload();
+
 	void SetActive(int slot = 0);
 
 private:
@@ -18,4 +24,6 @@ private:
 	unsigned int m_Id;
 	int m_Width;
 	int m_Height;
+	int m_NumChannels;
+	unsigned char* m_Data;		// decoded pixels until Upload
 };
\ No newline at end of file